@@ -0,0 +1,212 @@
+// Name: Phubeth Mettaprasert
+// File: BucketPatientQueue.h
+// Date: May 27, 2022
+//The header file and the implementation of the BucketPatientQueue. An
+// alternative to the PatientPriorityQueue that keeps one FIFO ring of Patient
+// objects for each triage code instead of a single heap. The number of codes
+// is a template parameter, so the rings are sized at compile time.
+// BucketPatientQueue has one ring for every code of the priority table.
+//Purpose: Since there are only a few priority codes and the arrival order only
+//         ever increases, the patients in one ring are always in arrival
+//         order. The next patient is the front of the first ring that is not
+//         empty, so add and remove run in constant time without any of the
+//         sifting the heap needs. Patients leave in the same order as
+//         Patient::operator< would give.
+
+#ifndef P3_BUCKETPATIENTQUEUE_H
+#define P3_BUCKETPATIENTQUEUE_H
+
+#include <string>
+#include <vector>
+#include <cassert>
+#include "Patient.h"
+#include "PriorityTable.h"
+
+using namespace std;
+
+template <int Levels = PRIORITY_LEVEL_COUNT>
+class BasicBucketPatientQueue {
+    static_assert(Levels >= 1 && Levels <= PRIORITY_LEVEL_COUNT,
+                  "Every level of the queue needs a code in the table");
+
+public:
+    BasicBucketPatientQueue();
+    // Constructor that initializes the BasicBucketPatientQueue class.
+    // preconditions: none
+    // postconditions: Sets the arrivalOrder to zero and every ring to empty.
+
+    void add(string, int);
+    // A method to add a Patient object to the back of the ring for its
+    // priority code.
+    // preconditions: The priority code must be between 1 and Levels.
+    // postconditions: A Patient object will be added to the ring for its
+    //                 priority code.
+
+    Patient remove();
+    // A method to remove the highest priority Patient object, which is the
+    // front of the first ring that is not empty.
+    // preconditions: The queue must not be empty.
+    // postconditions: The front Patient object of the first non empty ring
+    //                 will be removed and moved out to the caller.
+
+    const Patient &peek() const;
+    // Returns the highest priority patient without removing or copying the
+    // patient. The reference is valid until the queue is changed.
+    // preconditions: The queue must not be empty.
+    // postconditions: none
+
+    int size();
+    // Returns the number of patients still waiting.
+    // preconditions: none
+    // postconditions: none
+
+    string to_string() const;
+    // Returns the string represation of the object in the order the patients
+    // will be seen.
+    // preconditions: none. The queue can be empty.
+    // postconditions: none
+
+private:
+
+    int arrivalOrderNo; //A private variable to keep track of the arrival order
+    int nextPatientNumber; //Number of patients in all the rings
+
+    vector<Patient> rings[Levels]; //One ring per priority code
+    int heads[Levels]; //Index of the front Patient of each ring
+    int counts[Levels]; //Number of Patients in each ring
+
+    void grow(int);
+    // A method that doubles the capacity of a full ring. The Patients are
+    // moved so that the front of the ring is back at index zero.
+    // preconditions: The ring at the given bucket index is full.
+    // postconditions: The ring has room for at least one more Patient.
+
+    int firstNonEmpty() const;
+    // Returns the bucket index of the first ring that is not empty.
+    // preconditions: The queue must not be empty.
+    // postconditions: none
+
+    bool empty() const;
+    // A method to check if every ring is empty. Returns true if it is.
+    // preconditions: none
+    // postconditions: none
+};
+
+typedef BasicBucketPatientQueue<> BucketPatientQueue; //Every code of the table
+
+template <int Levels>
+BasicBucketPatientQueue<Levels>::BasicBucketPatientQueue() {
+
+    //Starts the arrival order number and the patient number at zero.
+    arrivalOrderNo = 0;
+    nextPatientNumber = 0;
+
+    //Every ring starts out empty
+    for (int i = 0; i < Levels; i++) {
+        heads[i] = 0;
+        counts[i] = 0;
+    }
+}
+
+template <int Levels>
+void BasicBucketPatientQueue<Levels>::add(string name, int priorityCode) {
+    assert(priorityCode >= 1 && priorityCode <= Levels);
+
+    //The bucket index is the priority code shifted to start at zero
+    int bucket = priorityCode - 1;
+    if (counts[bucket] == (int) rings[bucket].size())
+        grow(bucket);
+
+    //The back of the ring wraps around to the front of the vector
+    int capacity = rings[bucket].size();
+    int back = (heads[bucket] + counts[bucket]) % capacity;
+    rings[bucket][back] = Patient(std::move(name), priorityCode,
+                                  arrivalOrderNo);
+    counts[bucket]++;
+
+    //Increment the arrival order and the patient number
+    arrivalOrderNo++;
+    nextPatientNumber++;
+}
+
+template <int Levels>
+void BasicBucketPatientQueue<Levels>::grow(int bucket) {
+    int oldCapacity = rings[bucket].size();
+    int newCapacity = oldCapacity == 0 ? 8 : oldCapacity * 2;
+
+    //Move the Patients over in FIFO order so the front is at index zero
+    vector<Patient> grown(newCapacity);
+    for (int i = 0; i < counts[bucket]; i++) {
+        grown[i] = std::move(rings[bucket][(heads[bucket] + i) %
+                                           oldCapacity]);
+    }
+    rings[bucket].swap(grown);
+    heads[bucket] = 0;
+}
+
+template <int Levels>
+int BasicBucketPatientQueue<Levels>::firstNonEmpty() const {
+
+    //The lowest priority code that still has Patients waiting
+    int bucket = 0;
+    while (counts[bucket] == 0)
+        bucket++;
+    return bucket;
+}
+
+template <int Levels>
+Patient BasicBucketPatientQueue<Levels>::remove() {
+    //Assert if it is empty
+    assert(!empty());
+
+    //Take the front Patient of the first non empty ring
+    int bucket = firstNonEmpty();
+    Patient temp = std::move(rings[bucket][heads[bucket]]);
+    heads[bucket] = (heads[bucket] + 1) % (int) rings[bucket].size();
+    counts[bucket]--;
+
+    //Decrement
+    nextPatientNumber--;
+
+    //Return the old Patient object
+    return temp;
+}
+
+template <int Levels>
+const Patient &BasicBucketPatientQueue<Levels>::peek() const {
+
+    //The front of the first non empty ring
+    assert(!empty());
+    int bucket = firstNonEmpty();
+    return rings[bucket][heads[bucket]];
+}
+
+template <int Levels>
+bool BasicBucketPatientQueue<Levels>::empty() const {
+
+    //Check if there are still Patients in any of the rings
+    return nextPatientNumber == 0;
+}
+
+template <int Levels>
+string BasicBucketPatientQueue<Levels>::to_string() const {
+
+    //Print out every ring from the most urgent to the least urgent
+    string list;
+    for (int bucket = 0; bucket < Levels; bucket++) {
+        int capacity = rings[bucket].size();
+        for (int i = 0; i < counts[bucket]; i++) {
+            rings[bucket][(heads[bucket] + i) % capacity].appendTo(list);
+        }
+    }
+    return list;
+}
+
+template <int Levels>
+int BasicBucketPatientQueue<Levels>::size() {
+
+    //returns the number of patients in all the rings
+    return nextPatientNumber;
+}
+
+#endif //P3_BUCKETPATIENTQUEUE_H
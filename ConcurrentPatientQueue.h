@@ -0,0 +1,582 @@
+// Name: Phubeth Mettaprasert
+// File: ConcurrentPatientQueue.h
+// Date: May 27, 2022
+//The header file and the implementation of the ConcurrentPatientQueue. A
+// binary heap of Patient objects that any number of intake desks and
+// clinicians can add to and remove from at the same time.
+//Purpose: Every operation holds one mutex, so add, tryRemove and tryPeek are
+//         linearizable: each takes effect at one point while it holds the
+//         lock, and the arrival order is numbered there too, so the order
+//         Patients leave in is the order of Patient::operator< over the
+//         order the adds took effect. The critical section is kept short.
+//         The Patient is created and its name copied before the lock is
+//         taken, the heap only moves 8 byte order keys and shared pointers
+//         while it holds the lock, and a removed Patient is handed back as
+//         a shared pointer so it is read, formatted and freed by the caller
+//         after the lock is released. Clinician threads that have nothing
+//         to do can wait in waitAndRemove instead of polling. Each add wakes
+//         at most one waiting thread, and only when one is waiting, so a
+//         queue that always has patients never touches the condition
+//         variable.
+//
+//         Readers such as a dashboard that lists the queue every second take
+//         a snapshot instead of holding the lock while they walk the heap.
+//         The heap is stored in chunks of entries that are reference
+//         counted, and a snapshot shares the chunks as they are, so taking
+//         one only copies a pointer per chunk under the lock. A writer that
+//         is about to change a chunk a snapshot still holds copies it first
+//         and changes the copy, so a snapshot never changes once it is
+//         taken and can be read with no lock at all. This is read-copy-update
+//         with the reference counts of shared_ptr standing in for epochs: an
+//         old chunk, and the Patients removed since it was shared, are freed
+//         when the last snapshot that holds them is released, by whichever
+//         thread releases it, so never while the lock is held. The queue
+//         only keeps a weak pointer to the latest snapshot, so readers that
+//         find the queue unchanged share the one another reader still holds
+//         without taking the lock, and a snapshot nobody holds any more is
+//         freed instead of pinning old chunks.
+
+#ifndef P3_CONCURRENTPATIENTQUEUE_H
+#define P3_CONCURRENTPATIENTQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Patient.h"
+
+using namespace std;
+
+//A Patient handed out by a concurrent queue. Nobody changes the Patient
+// once it is in a queue, so it can be shared between threads.
+typedef shared_ptr<const Patient> PatientPtr;
+
+class ConcurrentPatientQueue {
+public:
+    class Snapshot;
+    // An immutable view of the queue at one point in time, in heap order.
+
+    ConcurrentPatientQueue();
+    // Constructor that initializes the ConcurrentPatientQueue class.
+    // preconditions: none
+    // postconditions: Sets the arrivalOrder to zero and the heap to empty.
+
+    ConcurrentPatientQueue(const ConcurrentPatientQueue &) = delete;
+    ConcurrentPatientQueue &operator=(const ConcurrentPatientQueue &) = delete;
+    // The queue is shared by threads through a reference, so it cannot be
+    // copied.
+
+    void add(string, int);
+    // A method to add a Patient object to the queue. The Patient is created
+    // from the name before the lock is taken, and is numbered with the next
+    // arrival order once the lock is held. Safe to call from any thread.
+    // preconditions: The priority code is in the priority table.
+    // postconditions: The Patient is in the queue, and one thread waiting
+    //                 in waitAndRemove is woken if any are waiting.
+
+    void add(string, int, int);
+    // Same as the other add, but the Patient keeps the arrival order given,
+    // for queues that share one arrival counter, like the shards of a
+    // ShardedPatientQueue. Patients are still ordered by the arrival order
+    // whatever order the adds take the lock in.
+    // preconditions: The priority code is in the priority table and no other
+    //                Patient in the queue has the arrival order.
+    // postconditions: Same as the other add.
+
+    PatientPtr tryRemove();
+    // A method to remove the highest priority Patient. Safe to call from any
+    // thread.
+    // preconditions: none
+    // postconditions: Returns the Patient, or a null pointer if the queue
+    //                 was empty.
+
+    int removeN(int, vector<PatientPtr> &);
+    // A method to remove the given number of highest priority Patients
+    // while holding the lock once, and append them to the end of the
+    // buffer in the order tryRemove would return them. Safe to call from
+    // any thread.
+    // preconditions: The number is not negative.
+    // postconditions: Returns how many Patients were removed, which is fewer
+    //                 than asked for if the queue runs out.
+
+    PatientPtr waitAndRemove();
+    // A method to remove the highest priority Patient, waiting until one is
+    // added if the queue is empty. Safe to call from any thread.
+    // preconditions: none
+    // postconditions: Returns the Patient, which is never a null pointer.
+
+    PatientPtr waitAndRemoveFor(chrono::milliseconds);
+    // Same as waitAndRemove, but waits for at most the timeout.
+    // preconditions: none
+    // postconditions: Returns the Patient, or a null pointer if no Patient
+    //                 could be removed before the timeout.
+
+    PatientPtr tryPeek() const;
+    // Returns the highest priority Patient without removing it. The Patient
+    // stays valid after another thread removes it. Safe to call from any
+    // thread.
+    // preconditions: none
+    // postconditions: Returns the Patient, or a null pointer if the queue
+    //                 was empty.
+
+    uint64_t peekKey() const;
+    // Returns the order key of the highest priority Patient without taking
+    // the lock, or EMPTY_KEY if the queue is empty, so a thread can compare
+    // the heads of many queues cheaply. The key may already be out of date
+    // when it returns if other threads are adding or removing.
+    // preconditions: none
+    // postconditions: none
+
+    static constexpr uint64_t EMPTY_KEY = UINT64_MAX;
+    // The key of an empty queue, which orders after every Patient.
+
+    int size() const;
+    // Returns the number of patients waiting without taking the lock, which
+    // may already be out of date when it returns if other threads are
+    // adding or removing.
+    // preconditions: none
+    // postconditions: none
+
+    shared_ptr<const Snapshot> snapshot() const;
+    // Returns a snapshot of every waiting Patient. If nothing was added or
+    // removed since the last snapshot and another reader still holds it,
+    // that one is returned without taking the lock. Otherwise the lock is
+    // held only to copy one pointer per chunk of the heap, however long the
+    // list is. Safe to call from any thread, and the snapshot can be read
+    // while others add and remove.
+    // preconditions: none
+    // postconditions: Returns the snapshot, which never changes.
+
+    string to_string() const;
+    // Returns the string represation of the queue in heap or level order.
+    // The rows are formatted from a snapshot, so the lock is not held while
+    // the list is walked.
+    // preconditions: none
+    // postconditions: none
+
+private:
+
+    //One node of the heap. The key is the order key of the Patient, so the
+    // sifts compare integers without following the pointer.
+    struct Entry {
+        uint64_t key;
+        PatientPtr patient;
+    };
+
+    //A block of the heap, shared with the snapshots taken since it was last
+    // changed. The sift after a snapshot copies a chunk for about every
+    // level below the sixth, so 64 entries keep those copies to a few
+    // microseconds, while a snapshot of 100000 patients copies only 1563
+    // pointers to chunks.
+    static constexpr int CHUNK_SHIFT = 6;
+    static constexpr int CHUNK_ENTRIES = 1 << CHUNK_SHIFT;
+    struct Chunk {
+        Entry entries[CHUNK_ENTRIES];
+    };
+
+    const Entry &entryAt(int) const;
+    // A method that assists the other methods. Returns the entry at the
+    // index of the heap for reading.
+    // preconditions: The lock is held and the index is below heapSize.
+    // postconditions: none
+
+    Entry &writableEntry(int);
+    // A method that assists the other methods. Returns the entry at the
+    // index of the heap for changing.
+    // preconditions: The lock is held and the index is below the number of
+    //                entries the chunks have room for.
+    // postconditions: No snapshot holds the chunk of the entry.
+
+    Chunk *unshare(int);
+    // A method that assists writableEntry. Replaces the chunk with a copy if
+    // a snapshot holds it, and marks it as owned by the queue. The chunk
+    // replaced is retired, so the caller frees it after the lock.
+    // preconditions: The lock is held.
+    // postconditions: Returns the chunk, which no snapshot holds.
+
+    void changed();
+    // A method that assists insert and removeRoot. Publishes the size, the
+    // key of the root and the new version of the heap.
+    // preconditions: The lock is held.
+    // postconditions: none
+
+    void insert(shared_ptr<Patient>, int);
+    // A method that assists the add methods. Puts the Patient in the heap.
+    // preconditions: The lock is held.
+    // postconditions: The Patient has the arrival order and is in the heap.
+
+    PatientPtr removeRoot();
+    // A method that assists the remove methods. Removes the root of the
+    // heap.
+    // preconditions: The lock is held and the heap is not empty.
+    // postconditions: Returns the Patient that was at the root.
+
+    void siftUp(int, Entry);
+    // A method that assists insert. Moves the entry up from the hole at the
+    // index until its parent has a smaller key.
+    // preconditions: The lock is held.
+    // postconditions: Heap order is maintained.
+
+    void siftDown(int, Entry);
+    // A method that assists removeRoot. Moves the entry down from the hole
+    // at the index until both of its children have larger keys.
+    // preconditions: The lock is held.
+    // postconditions: Heap order is maintained.
+
+    mutable mutex lock; //Held by every operation that reads or changes heap
+    condition_variable patientAdded; //Signalled by an add that has waiters
+    int waiters; //The threads waiting for a Patient, under lock
+    vector<shared_ptr<Chunk>> chunks; //The binary heap, in blocks, under lock
+    mutable vector<Chunk *> owned; //Each chunk, or null if a snapshot has it
+    vector<shared_ptr<Chunk>> retired; //Replaced chunks to free after lock
+    int heapSize; //The number of entries in the heap, under lock
+    int arrivalOrderNo; //The arrival order of the next Patient, under lock
+    atomic<int> count; //The size of the heap, readable without the lock
+    atomic<uint64_t> headKey; //The key of the root, readable without lock
+    atomic<uint64_t> version; //Counts the changes to the heap
+    mutable mutex latestLock; //Guards latest, and never held with the lock
+    mutable weak_ptr<const Snapshot> latest; //The last snapshot, if still held
+};
+
+class ConcurrentPatientQueue::Snapshot {
+public:
+    int size() const;
+    // Returns the number of patients that were waiting.
+    // preconditions: none
+    // postconditions: none
+
+    const Patient &operator[](int) const;
+    // Returns the Patient at the index in heap order, which stays valid for
+    // as long as the snapshot does.
+    // preconditions: The index is below size().
+    // postconditions: none
+
+    uint64_t getVersion() const;
+    // Returns the number of changes the queue had seen when the snapshot was
+    // taken, so a reader can tell whether two snapshots differ.
+    // preconditions: none
+    // postconditions: none
+
+    string to_string() const;
+    // Returns the string represation of the snapshot in heap order.
+    // preconditions: none
+    // postconditions: none
+
+private:
+    friend class ConcurrentPatientQueue;
+
+    Snapshot() = default;
+    // Only the queue takes snapshots.
+
+    vector<shared_ptr<const Chunk>> chunks; //The chunks of the heap, shared
+    int count = 0; //The number of entries in the chunks that are in use
+    uint64_t version = 0; //The version of the heap the chunks are from
+};
+
+ConcurrentPatientQueue::ConcurrentPatientQueue()
+        : count(0), headKey(EMPTY_KEY), version(0) {
+
+    //Starts the arrival order number at zero.
+    arrivalOrderNo = 0;
+    waiters = 0;
+    heapSize = 0;
+}
+
+void ConcurrentPatientQueue::add(string name, int priorityCode) {
+
+    //Allocate the Patient and move the name in before taking the lock
+    shared_ptr<Patient> patient =
+            make_shared<Patient>(std::move(name), priorityCode, 0);
+
+    //Chunks the add replaces are freed at the end, after the lock
+    vector<shared_ptr<Chunk>> released;
+    bool wakeWaiter;
+    {
+        lock_guard<mutex> guard(lock);
+
+        //The arrival order is taken here so it matches the order of the adds
+        insert(std::move(patient), arrivalOrderNo++);
+        wakeWaiter = waiters > 0;
+        released.swap(retired);
+    }
+
+    //One Patient is enough for one waiter, and notifying after the lock is
+    // released lets the waiter take the lock without blocking on it again
+    if (wakeWaiter)
+        patientAdded.notify_one();
+}
+
+void ConcurrentPatientQueue::add(string name, int priorityCode,
+                                 int arrivalOrder) {
+    shared_ptr<Patient> patient =
+            make_shared<Patient>(std::move(name), priorityCode, 0);
+
+    vector<shared_ptr<Chunk>> released;
+    bool wakeWaiter;
+    {
+        lock_guard<mutex> guard(lock);
+        insert(std::move(patient), arrivalOrder);
+        wakeWaiter = waiters > 0;
+        released.swap(retired);
+    }
+    if (wakeWaiter)
+        patientAdded.notify_one();
+}
+
+PatientPtr ConcurrentPatientQueue::tryRemove() {
+
+    //Declared before the guard, so replaced chunks are freed after unlock
+    vector<shared_ptr<Chunk>> released;
+    lock_guard<mutex> guard(lock);
+    if (heapSize == 0)
+        return PatientPtr();
+
+    //The caller frees the Patient once it is done with it, outside the lock
+    PatientPtr next = removeRoot();
+    released.swap(retired);
+    return next;
+}
+
+int ConcurrentPatientQueue::removeN(int count,
+                                    vector<PatientPtr> &buffer) {
+
+    //Make room before taking the lock so the buffer does not grow under it
+    buffer.reserve(buffer.size() + max(count, 0));
+
+    vector<shared_ptr<Chunk>> released;
+    lock_guard<mutex> guard(lock);
+    count = min(count, heapSize);
+    for (int i = 0; i < count; i++)
+        buffer.push_back(removeRoot());
+    released.swap(retired);
+    return max(count, 0);
+}
+
+PatientPtr ConcurrentPatientQueue::waitAndRemove() {
+    vector<shared_ptr<Chunk>> released;
+    unique_lock<mutex> guard(lock);
+
+    //Only an empty queue makes the caller wait, and another thread may take
+    // the Patient of the add that woke this one, so check again every time
+    if (heapSize == 0) {
+        waiters++;
+        patientAdded.wait(guard, [this]() { return heapSize > 0; });
+        waiters--;
+    }
+    PatientPtr next = removeRoot();
+    released.swap(retired);
+    return next;
+}
+
+PatientPtr ConcurrentPatientQueue::waitAndRemoveFor(
+        chrono::milliseconds timeout) {
+    vector<shared_ptr<Chunk>> released;
+    unique_lock<mutex> guard(lock);
+    if (heapSize == 0) {
+        waiters++;
+        bool added = patientAdded.wait_for(guard, timeout, [this]() {
+            return heapSize > 0;
+        });
+        waiters--;
+        if (!added)
+            return PatientPtr();
+    }
+    PatientPtr next = removeRoot();
+    released.swap(retired);
+    return next;
+}
+
+PatientPtr ConcurrentPatientQueue::tryPeek() const {
+    lock_guard<mutex> guard(lock);
+    if (heapSize == 0)
+        return PatientPtr();
+    return entryAt(0).patient;
+}
+
+uint64_t ConcurrentPatientQueue::peekKey() const {
+    return headKey.load(memory_order_relaxed);
+}
+
+int ConcurrentPatientQueue::size() const {
+    return count.load(memory_order_relaxed);
+}
+
+shared_ptr<const ConcurrentPatientQueue::Snapshot>
+ConcurrentPatientQueue::snapshot() const {
+
+    //A dashboard polling a queue that has not changed shares the snapshot
+    // another reader is still holding. The pointer is declared out here so
+    // a snapshot this makes the last holder of is freed after the guard.
+    shared_ptr<const Snapshot> shared;
+    {
+        lock_guard<mutex> guard(latestLock);
+        shared = latest.lock();
+    }
+    if (shared != nullptr &&
+        shared->version == version.load(memory_order_acquire))
+        return shared;
+
+    //Make room before taking the lock, which is then only held to share the
+    // chunks, however many patients they hold
+    shared_ptr<Snapshot> fresh(new Snapshot());
+    fresh->chunks.reserve(size() / CHUNK_ENTRIES + 2);
+    {
+        lock_guard<mutex> guard(lock);
+        fresh->chunks.assign(chunks.begin(), chunks.end());
+        fresh->count = heapSize;
+        fresh->version = version.load(memory_order_relaxed);
+
+        //Every chunk may be shared now, until a writer checks it again
+        fill(owned.begin(), owned.end(), nullptr);
+    }
+
+    //Only a weak pointer is kept, so nothing is freed here and the snapshot
+    // goes away with its last reader
+    {
+        lock_guard<mutex> guard(latestLock);
+        latest = fresh;
+    }
+    return fresh;
+}
+
+string ConcurrentPatientQueue::to_string() const {
+    return snapshot()->to_string();
+}
+
+void ConcurrentPatientQueue::insert(shared_ptr<Patient> patient,
+                                    int arrivalOrder) {
+    patient->setArrivalOrder(arrivalOrder);
+
+    //Add a chunk when the last one is full
+    if (heapSize == (int) chunks.size() * CHUNK_ENTRIES) {
+        chunks.push_back(make_shared<Chunk>());
+        owned.push_back(chunks.back().get());
+    }
+    uint64_t key = patient->getOrderKey();
+    siftUp(heapSize++, {key, std::move(patient)});
+    changed();
+}
+
+PatientPtr ConcurrentPatientQueue::removeRoot() {
+
+    //Move the root out and the last entry down from its place
+    PatientPtr next = std::move(writableEntry(0).patient);
+    heapSize--;
+    if (heapSize > 0) {
+        Entry last = std::move(writableEntry(heapSize));
+        siftDown(0, std::move(last));
+    }
+
+    //Keep one empty chunk past the end, so a queue that hovers around a
+    // chunk boundary does not allocate and free one chunk over and over
+    while ((int) chunks.size() * CHUNK_ENTRIES >=
+           heapSize + 2 * CHUNK_ENTRIES) {
+        chunks.pop_back();
+        owned.pop_back();
+    }
+    changed();
+    return next;
+}
+
+const ConcurrentPatientQueue::Entry &
+ConcurrentPatientQueue::entryAt(int index) const {
+    return chunks[index >> CHUNK_SHIFT]->entries[index & (CHUNK_ENTRIES - 1)];
+}
+
+ConcurrentPatientQueue::Entry &
+ConcurrentPatientQueue::writableEntry(int index) {
+
+    //Only the first write to a chunk after a snapshot looks at its count
+    Chunk *chunk = owned[index >> CHUNK_SHIFT];
+    if (chunk == nullptr)
+        chunk = unshare(index >> CHUNK_SHIFT);
+    return chunk->entries[index & (CHUNK_ENTRIES - 1)];
+}
+
+ConcurrentPatientQueue::Chunk *ConcurrentPatientQueue::unshare(int chunk) {
+
+    //Snapshots only take a chunk under the lock, so a chunk nobody else
+    // holds stays that way, and the fence orders the reads of the last
+    // snapshot to release it before the writes that follow
+    if (chunks[chunk].use_count() > 1) {
+
+        //The snapshots can all let go of the old chunk before the copy is
+        // put in its place, so the queue keeps it until the lock is released
+        shared_ptr<Chunk> copy = make_shared<Chunk>(*chunks[chunk]);
+        retired.push_back(std::move(chunks[chunk]));
+        chunks[chunk] = std::move(copy);
+    } else {
+        atomic_thread_fence(memory_order_acquire);
+    }
+    owned[chunk] = chunks[chunk].get();
+    return owned[chunk];
+}
+
+void ConcurrentPatientQueue::changed() {
+    count.store(heapSize, memory_order_relaxed);
+    headKey.store(heapSize == 0 ? EMPTY_KEY : entryAt(0).key,
+                  memory_order_relaxed);
+    version.store(version.load(memory_order_relaxed) + 1,
+                  memory_order_release);
+}
+
+void ConcurrentPatientQueue::siftUp(int index, Entry entry) {
+
+    //Shift parents down into the hole until the entry fits
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (entryAt(parent).key <= entry.key)
+            break;
+        Entry &hole = writableEntry(index);
+        hole = std::move(writableEntry(parent));
+        index = parent;
+    }
+    writableEntry(index) = std::move(entry);
+}
+
+void ConcurrentPatientQueue::siftDown(int index, Entry entry) {
+
+    //Shift the smaller child up into the hole until the entry fits
+    while (2 * index + 1 < heapSize) {
+        int child = 2 * index + 1;
+        if (child + 1 < heapSize &&
+            entryAt(child + 1).key < entryAt(child).key)
+            child++;
+        if (entry.key <= entryAt(child).key)
+            break;
+        Entry &hole = writableEntry(index);
+        hole = std::move(writableEntry(child));
+        index = child;
+    }
+    writableEntry(index) = std::move(entry);
+}
+
+int ConcurrentPatientQueue::Snapshot::size() const {
+    return count;
+}
+
+const Patient &ConcurrentPatientQueue::Snapshot::operator[](int index) const {
+    assert(index >= 0 && index < count);
+    return *chunks[index >> CHUNK_SHIFT]->entries[index & (CHUNK_ENTRIES - 1)]
+            .patient;
+}
+
+uint64_t ConcurrentPatientQueue::Snapshot::getVersion() const {
+    return version;
+}
+
+string ConcurrentPatientQueue::Snapshot::to_string() const {
+    string temp;
+    for (int i = 0; i < count; i++)
+        (*this)[i].appendTo(temp);
+    return temp;
+}
+
+#endif //P3_CONCURRENTPATIENTQUEUE_H
@@ -0,0 +1,249 @@
+// Name: Phubeth Mettaprasert
+// File: LockFreeBucketQueue.h
+// Date: May 27, 2022
+//The header file and the implementation of the LockFreeBucketQueue. A queue
+// of Patient objects with one lock-free ring per priority code that any
+// number of threads can add to and remove from without taking a lock.
+//Purpose: With only a few priority codes the queue does not need a heap.
+//         Like BucketPatientQueue it keeps one FIFO per code, but each FIFO
+//         is a bounded ring where adding and removing claim a ticket with a
+//         compare and swap on the tail or the head of the ring, and a
+//         sequence number in every cell tells a thread whether the cell is
+//         ready to be written or read. Threads only ever wait on each other
+//         for as long as one compare and swap, so adds and nexts of
+//         different codes never touch the same memory, and the queue keeps
+//         scaling where one mutex around a heap would have every thread
+//         wait in line.
+//
+//         Patients leave a ring in the order their adds claimed tickets. So
+//         that the arrival order agrees with that, an add draws its arrival
+//         number from the shared counter after it reads the tail and before
+//         it tries to claim it, and draws a new number every time the claim
+//         fails. The add that claims the next ticket read the tail only
+//         after the claim before it, so it always gets a larger number, and
+//         Patients of one code leave in the order of Patient::operator<.
+//         The numbers that failed claims drew are skipped, so the arrival
+//         numbers have gaps when adds race.
+//
+//         A remove looks at the rings from immediate to minimal, one at a
+//         time. A Patient of a higher priority that is added while a remove
+//         is past its ring, or whose add has claimed a ticket but not yet
+//         written the Patient, is left for the next remove, as if its add
+//         had come just after.
+
+#ifndef P3_LOCKFREEBUCKETQUEUE_H
+#define P3_LOCKFREEBUCKETQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include "Patient.h"
+#include "PriorityTable.h"
+
+using namespace std;
+
+template <int Levels = PRIORITY_LEVEL_COUNT>
+class BasicLockFreeBucketQueue {
+    static_assert(Levels >= 1 && Levels <= PRIORITY_LEVEL_COUNT,
+                  "Every level of the queue needs a code in the table");
+
+public:
+    explicit BasicLockFreeBucketQueue(int = 4096);
+    // Constructor that initializes the BasicLockFreeBucketQueue class with
+    // room for the number of Patients in every ring, rounded up to a power
+    // of two.
+    // preconditions: The number is positive.
+    // postconditions: Sets the arrivalOrder to zero and every ring to empty.
+
+    BasicLockFreeBucketQueue(const BasicLockFreeBucketQueue &) = delete;
+    BasicLockFreeBucketQueue &operator=(const BasicLockFreeBucketQueue &) =
+            delete;
+    // The queue is shared by threads through a reference, so it cannot be
+    // copied.
+
+    bool add(string, int);
+    // A method to add a Patient object to the back of the ring for its
+    // priority code. Safe to call from any thread, and never waits for a
+    // lock.
+    // preconditions: The priority code is between 1 and Levels.
+    // postconditions: Returns false without adding the Patient if the ring
+    //                 for its code is full.
+
+    optional<Patient> tryRemove();
+    // A method to remove the Patient at the front of the first ring that is
+    // not empty. Safe to call from any thread, and never waits for a lock.
+    // preconditions: none
+    // postconditions: Returns the Patient, or nothing if every ring was
+    //                 empty.
+
+    int size() const;
+    // Returns the number of patients waiting, which may already be out of
+    // date when it returns if other threads are adding or removing.
+    // preconditions: none
+    // postconditions: none
+
+    int capacity() const;
+    // Returns the number of Patients every ring has room for.
+    // preconditions: none
+    // postconditions: none
+
+private:
+
+    //One place in a ring. The sequence is the ticket of the add that may
+    // write the cell next, or that ticket plus one once the Patient is in
+    // it and the remove with that ticket may read it.
+    struct alignas(64) Cell {
+        atomic<size_t> sequence;
+        Patient patient;
+    };
+
+    //The head and the tail are on cache lines of their own, so adding
+    // threads and removing threads do not take the line from each other.
+    struct Ring {
+        alignas(64) atomic<size_t> tail; //The ticket of the next add
+        alignas(64) atomic<size_t> head; //The ticket of the next remove
+        unique_ptr<Cell[]> cells; //The cell of a ticket is ticket & mask
+    };
+
+    bool tryRemoveFrom(Ring &, Patient &);
+    // A method that assists tryRemove. Removes the Patient at the front of
+    // the ring.
+    // preconditions: none
+    // postconditions: Returns false if the ring has no Patient ready.
+
+    Ring rings[Levels]; //One ring for each priority code, immediate first
+    size_t mask; //The number of cells in a ring minus one
+    alignas(64) atomic<int> arrivalOrderNo; //Drawn by every claim of an add
+};
+
+template <int Levels>
+BasicLockFreeBucketQueue<Levels>::BasicLockFreeBucketQueue(int capacity) {
+    assert(capacity > 0);
+
+    //The cell of a ticket is found with a mask, so round up to a power of 2
+    size_t cells = 1;
+    while (cells < (size_t) capacity)
+        cells *= 2;
+    mask = cells - 1;
+
+    //Every cell starts out ready for the add with its own index as ticket
+    for (Ring &ring : rings) {
+        ring.tail.store(0, memory_order_relaxed);
+        ring.head.store(0, memory_order_relaxed);
+        ring.cells.reset(new Cell[cells]);
+        for (size_t i = 0; i < cells; i++)
+            ring.cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    //Starts the arrival order number at zero.
+    arrivalOrderNo.store(0, memory_order_relaxed);
+}
+
+template <int Levels>
+bool BasicLockFreeBucketQueue<Levels>::add(string name, int priorityCode) {
+    assert(priorityCode >= 1 && priorityCode <= Levels);
+    Ring &ring = rings[priorityCode - 1];
+
+    size_t ticket = ring.tail.load(memory_order_acquire);
+    int arrivalOrder;
+    for (;;) {
+        Cell &cell = ring.cells[ticket & mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        intptr_t ahead = (intptr_t) (sequence - ticket);
+        if (ahead == 0) {
+
+            //Draw the number between reading the tail and claiming it, so
+            // the next ticket, which can only be read after this claim,
+            // gets a larger number
+            arrivalOrder = arrivalOrderNo.fetch_add(1, memory_order_relaxed);
+            if (ring.tail.compare_exchange_strong(ticket, ticket + 1,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire))
+                break;
+        } else if (ahead < 0) {
+
+            //The cell still holds the Patient from a lap ago
+            return false;
+        } else {
+
+            //Another add claimed the ticket first
+            ticket = ring.tail.load(memory_order_acquire);
+        }
+    }
+
+    //The ticket is ours, so write the Patient and hand the cell to removes
+    Cell &cell = ring.cells[ticket & mask];
+    cell.patient = Patient(std::move(name), priorityCode, arrivalOrder);
+    cell.sequence.store(ticket + 1, memory_order_release);
+    return true;
+}
+
+template <int Levels>
+optional<Patient> BasicLockFreeBucketQueue<Levels>::tryRemove() {
+    Patient next;
+
+    //The first ring with a Patient ready holds the next patient
+    for (Ring &ring : rings) {
+        if (tryRemoveFrom(ring, next))
+            return next;
+    }
+    return nullopt;
+}
+
+template <int Levels>
+bool BasicLockFreeBucketQueue<Levels>::tryRemoveFrom(Ring &ring,
+                                                     Patient &next) {
+    size_t ticket = ring.head.load(memory_order_relaxed);
+    for (;;) {
+        Cell &cell = ring.cells[ticket & mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        intptr_t ahead = (intptr_t) (sequence - (ticket + 1));
+        if (ahead == 0) {
+            if (ring.head.compare_exchange_weak(ticket, ticket + 1,
+                                                memory_order_relaxed))
+                break;
+        } else if (ahead < 0) {
+
+            //Empty, or the add of the ticket has not written its Patient
+            return false;
+        } else {
+
+            //Another remove claimed the ticket first
+            ticket = ring.head.load(memory_order_relaxed);
+        }
+    }
+
+    //Move the Patient out and hand the cell to the add one lap later
+    Cell &cell = ring.cells[ticket & mask];
+    next = std::move(cell.patient);
+    cell.sequence.store(ticket + mask + 1, memory_order_release);
+    return true;
+}
+
+template <int Levels>
+int BasicLockFreeBucketQueue<Levels>::size() const {
+    long waiting = 0;
+    for (const Ring &ring : rings) {
+        size_t head = ring.head.load(memory_order_relaxed);
+        size_t tail = ring.tail.load(memory_order_relaxed);
+        waiting += (long) (tail - head);
+    }
+
+    //Reading the head after the tail can make a ring look negative
+    return waiting < 0 ? 0 : (int) waiting;
+}
+
+template <int Levels>
+int BasicLockFreeBucketQueue<Levels>::capacity() const {
+    return (int) (mask + 1);
+}
+
+//The lock-free queue with one ring for every code of the priority table
+typedef BasicLockFreeBucketQueue<> LockFreeBucketQueue;
+
+#endif //P3_LOCKFREEBUCKETQUEUE_H
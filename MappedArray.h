@@ -0,0 +1,364 @@
+// Name: Phubeth Mettaprasert
+// File: MappedArray.h
+// Date: May 27, 2022
+//The header file and the implementation of the MappedArray class. An array
+// of trivially copyable values that can back the heap of a
+// BasicPatientPriorityQueue instead of a vector.
+//Purpose: A vector that runs out of room allocates a buffer twice the size
+//         and copies every value into it, which for tens of millions of
+//         entries means copying hundreds of megabytes at a time. A
+//         MappedArray reserves one range of addresses large enough for
+//         every index an int can hold with an anonymous mmap up front, and
+//         grows by making more of that range usable in place, so values
+//         never move. With huge pages on, the range is aligned to 2 MB and
+//         marked with MADV_HUGEPAGE so the kernel can back it with huge
+//         pages and the TLB covers far more of the heap. Shrinking hands the
+//         pages past the new capacity back to the kernel without copying.
+
+#ifndef P3_MAPPEDARRAY_H
+#define P3_MAPPEDARRAY_H
+
+#include <sys/mman.h>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+template <class T, class Allocator = allocator<T>>
+class MappedArray {
+    static_assert(is_trivially_copyable<T>::value,
+                  "A MappedArray holds values that can be copied as bytes");
+
+public:
+    typedef T value_type;
+    typedef Allocator allocator_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    static constexpr size_t HUGE_PAGE_BYTES = 2 << 20; //The x86-64 huge page
+
+    explicit MappedArray(const Allocator & = Allocator());
+    // Constructor that initializes the MappedArray class with huge pages on.
+    // The allocator is only kept so the array can stand in for a vector,
+    // since the memory comes straight from the kernel.
+    // preconditions: none
+    // postconditions: Reserves the addresses for INT_MAX values. Throws
+    //                 bad_alloc if the addresses cannot be reserved.
+
+    MappedArray(bool, const Allocator & = Allocator());
+    // Constructor that sets whether the array asks for huge pages.
+    // preconditions: none
+    // postconditions: Same as the other constructor.
+
+    ~MappedArray();
+    // Destructor that gives the whole range of addresses back.
+    // preconditions: none
+    // postconditions: none
+
+    MappedArray(const MappedArray &) = delete;
+    MappedArray &operator=(const MappedArray &) = delete;
+    // The range of addresses is owned by one array, so it cannot be copied.
+
+    MappedArray(MappedArray &&) noexcept;
+    // Move constructor that takes over the range of the other array.
+    // preconditions: none
+    // postconditions: The other array is left empty with no range.
+
+    void push_back(const T &);
+    // Appends the value, making more of the range usable if it is full.
+    // preconditions: The array holds fewer than INT_MAX values.
+    // postconditions: Throws bad_alloc if the kernel refuses the pages.
+
+    void pop_back();
+    // Removes the last value. The page it was on stays usable.
+    // preconditions: The array is not empty.
+    // postconditions: none
+
+    void resize(size_t, const T & = T());
+    // Grows the array with copies of the value or drops values at the end.
+    // preconditions: The size is at most INT_MAX.
+    // postconditions: The array has the size.
+
+    void reserve(size_t);
+    // Makes room for the number of values without moving any of them.
+    // preconditions: The number is at most INT_MAX.
+    // postconditions: The capacity is at least the number.
+
+    void shrinkTo(size_t);
+    // Gives the pages past the larger of the size and the capacity given
+    // back to the kernel, without moving any values.
+    // preconditions: none
+    // postconditions: The capacity is at most the larger of the two,
+    //                 rounded up to a whole page.
+
+    void swap(MappedArray &) noexcept;
+    // Swaps the ranges of the two arrays.
+    // preconditions: none
+    // postconditions: none
+
+    T &operator[](size_t);
+    // Returns the value at the index.
+    // preconditions: The index is below the size.
+    // postconditions: none
+
+    const T &operator[](size_t) const;
+    // Returns the value at the index.
+    // preconditions: The index is below the size.
+    // postconditions: none
+
+    T *data();
+    const T *data() const;
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    // Pointers to the values, which stay put for the life of the array.
+
+    size_t size() const;
+    // Returns the number of values in the array.
+    // preconditions: none
+    // postconditions: none
+
+    size_t capacity() const;
+    // Returns the number of values the usable pages have room for.
+    // preconditions: none
+    // postconditions: none
+
+    bool empty() const;
+    // Returns true if there are no values in the array.
+    // preconditions: none
+    // postconditions: none
+
+    Allocator get_allocator() const;
+    // Returns the allocator the array was created with.
+    // preconditions: none
+    // postconditions: none
+
+private:
+
+    void commit(size_t);
+    // A method that assists push_back, resize and reserve. Makes the bytes
+    // from the start of the range usable, in whole pages.
+    // preconditions: The bytes fit in the range.
+    // postconditions: Throws bad_alloc if the kernel refuses.
+
+    Allocator allocator; //Only kept for get_allocator
+    char *region; //The start of the reserved range, aligned to a page
+    size_t regionBytes; //The length of the reserved range
+    void *mapping; //What mmap returned, before the range was aligned
+    size_t mappingBytes; //What was passed to mmap
+    size_t committedBytes; //The usable bytes at the start of the range
+    size_t count; //The number of values in the array
+    bool hugePages; //Whether the range grows in huge pages
+};
+
+template <class T, class Allocator>
+MappedArray<T, Allocator>::MappedArray(const Allocator &allocator)
+        : MappedArray(true, allocator) {
+}
+
+template <class T, class Allocator>
+MappedArray<T, Allocator>::MappedArray(bool hugePages,
+                                       const Allocator &allocator)
+        : allocator(allocator) {
+    this->hugePages = hugePages;
+    committedBytes = 0;
+    count = 0;
+
+    //Reserve addresses without memory behind them, plus a huge page of
+    // extra room so the start can be moved up to a huge page boundary
+    regionBytes = (size_t) INT_MAX * sizeof(T);
+    regionBytes = (regionBytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES *
+                  HUGE_PAGE_BYTES;
+    mappingBytes = regionBytes + HUGE_PAGE_BYTES;
+    mapping = mmap(nullptr, mappingBytes, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw bad_alloc();
+    uintptr_t start = (uintptr_t) mapping;
+    start = (start + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    region = (char *) start;
+
+#ifdef MADV_HUGEPAGE
+    //Only a hint, so a kernel without transparent huge pages ignores it
+    if (hugePages)
+        madvise(region, regionBytes, MADV_HUGEPAGE);
+#endif
+}
+
+template <class T, class Allocator>
+MappedArray<T, Allocator>::~MappedArray() {
+    if (mapping != nullptr)
+        munmap(mapping, mappingBytes);
+}
+
+template <class T, class Allocator>
+MappedArray<T, Allocator>::MappedArray(MappedArray &&other) noexcept
+        : allocator(other.allocator) {
+    region = other.region;
+    regionBytes = other.regionBytes;
+    mapping = other.mapping;
+    mappingBytes = other.mappingBytes;
+    committedBytes = other.committedBytes;
+    count = other.count;
+    hugePages = other.hugePages;
+
+    //The other array no longer owns a range
+    other.region = nullptr;
+    other.regionBytes = 0;
+    other.mapping = nullptr;
+    other.mappingBytes = 0;
+    other.committedBytes = 0;
+    other.count = 0;
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::commit(size_t bytes) {
+    assert(bytes <= regionBytes);
+
+    //Grow by at least doubling, in whole huge pages or normal pages
+    size_t page = hugePages ? HUGE_PAGE_BYTES : 4096;
+    size_t target = max(bytes, 2 * committedBytes);
+    target = min((target + page - 1) / page * page, regionBytes);
+
+    //The new pages are filled with zeros by the kernel on first touch
+    if (mprotect(region + committedBytes, target - committedBytes,
+                 PROT_READ | PROT_WRITE) != 0)
+        throw bad_alloc();
+    committedBytes = target;
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::push_back(const T &value) {
+    if ((count + 1) * sizeof(T) > committedBytes)
+        commit((count + 1) * sizeof(T));
+    data()[count++] = value;
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::pop_back() {
+    assert(count > 0);
+    count--;
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::resize(size_t newSize, const T &value) {
+    if (newSize * sizeof(T) > committedBytes)
+        commit(newSize * sizeof(T));
+    for (size_t i = count; i < newSize; i++)
+        data()[i] = value;
+    count = newSize;
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::reserve(size_t values) {
+    if (values * sizeof(T) > committedBytes)
+        commit(values * sizeof(T));
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::shrinkTo(size_t values) {
+    size_t page = hugePages ? HUGE_PAGE_BYTES : 4096;
+    size_t keep = max(values, count) * sizeof(T);
+    keep = (keep + page - 1) / page * page;
+    if (keep >= committedBytes)
+        return;
+
+    //Mapping fresh inaccessible pages over the tail frees the memory and
+    // the commit charge while keeping the addresses reserved
+    void *tail = mmap(region + keep, committedBytes - keep, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                      -1, 0);
+    if (tail == MAP_FAILED)
+        return;
+#ifdef MADV_HUGEPAGE
+    if (hugePages)
+        madvise(tail, committedBytes - keep, MADV_HUGEPAGE);
+#endif
+    committedBytes = keep;
+}
+
+template <class T, class Allocator>
+void MappedArray<T, Allocator>::swap(MappedArray &other) noexcept {
+    using std::swap;
+    swap(allocator, other.allocator);
+    swap(region, other.region);
+    swap(regionBytes, other.regionBytes);
+    swap(mapping, other.mapping);
+    swap(mappingBytes, other.mappingBytes);
+    swap(committedBytes, other.committedBytes);
+    swap(count, other.count);
+    swap(hugePages, other.hugePages);
+}
+
+template <class T, class Allocator>
+T &MappedArray<T, Allocator>::operator[](size_t index) {
+    return data()[index];
+}
+
+template <class T, class Allocator>
+const T &MappedArray<T, Allocator>::operator[](size_t index) const {
+    return data()[index];
+}
+
+template <class T, class Allocator>
+T *MappedArray<T, Allocator>::data() {
+    return (T *) region;
+}
+
+template <class T, class Allocator>
+const T *MappedArray<T, Allocator>::data() const {
+    return (const T *) region;
+}
+
+template <class T, class Allocator>
+typename MappedArray<T, Allocator>::iterator
+MappedArray<T, Allocator>::begin() {
+    return data();
+}
+
+template <class T, class Allocator>
+typename MappedArray<T, Allocator>::iterator
+MappedArray<T, Allocator>::end() {
+    return data() + count;
+}
+
+template <class T, class Allocator>
+typename MappedArray<T, Allocator>::const_iterator
+MappedArray<T, Allocator>::begin() const {
+    return data();
+}
+
+template <class T, class Allocator>
+typename MappedArray<T, Allocator>::const_iterator
+MappedArray<T, Allocator>::end() const {
+    return data() + count;
+}
+
+template <class T, class Allocator>
+size_t MappedArray<T, Allocator>::size() const {
+    return count;
+}
+
+template <class T, class Allocator>
+size_t MappedArray<T, Allocator>::capacity() const {
+    return committedBytes / sizeof(T);
+}
+
+template <class T, class Allocator>
+bool MappedArray<T, Allocator>::empty() const {
+    return count == 0;
+}
+
+template <class T, class Allocator>
+Allocator MappedArray<T, Allocator>::get_allocator() const {
+    return allocator;
+}
+
+#endif //P3_MAPPEDARRAY_H
@@ -0,0 +1,27 @@
+// Name: Phubeth Mettaprasert
+// File: MappedPatientPriorityQueue.h
+// Date: May 27, 2022
+//The header file of the MappedPatientPriorityQueue. Contains the heap whose
+// arrays are MappedArrays.
+//Purpose: Keeps the storage that needs POSIX mmap out of
+//         PatientPriorityQueue.h, so the triage program builds on platforms
+//         without <sys/mman.h>, such as MinGW on Windows. Only the code that
+//         asks for the mapped heap includes this header.
+
+#ifndef P3_MAPPEDPATIENTPRIORITYQUEUE_H
+#define P3_MAPPEDPATIENTPRIORITYQUEUE_H
+
+#include <memory>
+#include "MappedArray.h"
+#include "PatientPriorityQueue.h"
+#include "PatientRecord.h"
+
+using namespace std;
+
+//A heap backed by MappedArrays, for simulations of tens of millions of
+// patients
+template <int Arity>
+using MappedPatientPriorityQueue =
+        BasicPatientPriorityQueue<Arity, allocator<PatientRecord>, MappedArray>;
+
+#endif //P3_MAPPEDPATIENTPRIORITYQUEUE_H
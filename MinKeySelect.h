@@ -0,0 +1,109 @@
+// Name: Phubeth Mettaprasert
+// File: MinKeySelect.h
+// Date: May 27, 2022
+//The header file and the implementation of the functions that find the
+// smallest of the packed order keys of the children of a heap node.
+//Purpose: In an 8-ary heap the children of a node are 8 keys next to each
+//         other. On x86-64 processors with AVX2, the smallest of them is
+//         found with vector compares and blends instead of a chain of
+//         branches. Whether the processor has AVX2 is checked once at run
+//         time, and the scalar loop is used when it does not.
+
+#ifndef P3_MINKEYSELECT_H
+#define P3_MINKEYSELECT_H
+
+#include <cstdint>
+
+//Only on x86-64, since the index is read out with a 64 bit move
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define P3_HAVE_AVX2_SELECT 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+inline int minKeyScalar(const uint64_t *, int);
+// Returns the offset of the smallest of the keys by comparing them one by
+// one.
+// preconditions: There is at least one key.
+// postconditions: none
+
+inline int minOfEightKeys(const uint64_t *);
+// Returns the offset of the smallest of 8 keys, using AVX2 when the
+// processor has it and the scalar loop when it does not.
+// preconditions: There are 8 keys and every key is below 2^63.
+// postconditions: none
+
+inline bool hasAvx2();
+// Returns true if the processor running the program supports AVX2. The
+// answer is worked out on the first call and remembered.
+// preconditions: none
+// postconditions: none
+
+#ifdef P3_HAVE_AVX2_SELECT
+__attribute__((target("avx2")))
+inline int minOfEightKeysAvx2(const uint64_t *);
+// Returns the offset of the smallest of 8 keys using AVX2. Only call it if
+// hasAvx2() is true.
+// preconditions: There are 8 keys and every key is below 2^63, since AVX2
+//                only compares signed 64 bit integers.
+// postconditions: none
+#endif
+
+inline int minKeyScalar(const uint64_t *keys, int count) {
+    int minIndex = 0;
+    for (int i = 1; i < count; i++) {
+        if (keys[i] < keys[minIndex])
+            minIndex = i;
+    }
+    return minIndex;
+}
+
+inline bool hasAvx2() {
+#ifdef P3_HAVE_AVX2_SELECT
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+#ifdef P3_HAVE_AVX2_SELECT
+__attribute__((target("avx2")))
+inline int minOfEightKeysAvx2(const uint64_t *keys) {
+
+    //Keys 0 to 3 against keys 4 to 7, keeping the smaller key and its offset
+    __m256i low = _mm256_loadu_si256((const __m256i *) keys);
+    __m256i high = _mm256_loadu_si256((const __m256i *) (keys + 4));
+    __m256i lowIndex = _mm256_setr_epi64x(0, 1, 2, 3);
+    __m256i highIndex = _mm256_setr_epi64x(4, 5, 6, 7);
+    __m256i takeHigh = _mm256_cmpgt_epi64(low, high);
+    __m256i best = _mm256_blendv_epi8(low, high, takeHigh);
+    __m256i bestIndex = _mm256_blendv_epi8(lowIndex, highIndex, takeHigh);
+
+    //The two 128 bit halves against each other
+    __m256i other = _mm256_permute4x64_epi64(best, 0x4E);
+    __m256i otherIndex = _mm256_permute4x64_epi64(bestIndex, 0x4E);
+    __m256i takeOther = _mm256_cmpgt_epi64(best, other);
+    best = _mm256_blendv_epi8(best, other, takeOther);
+    bestIndex = _mm256_blendv_epi8(bestIndex, otherIndex, takeOther);
+
+    //The two keys of the low half against each other
+    other = _mm256_permute4x64_epi64(best, 0xB1);
+    otherIndex = _mm256_permute4x64_epi64(bestIndex, 0xB1);
+    takeOther = _mm256_cmpgt_epi64(best, other);
+    bestIndex = _mm256_blendv_epi8(bestIndex, otherIndex, takeOther);
+
+    return (int) _mm_cvtsi128_si64(_mm256_castsi256_si128(bestIndex));
+}
+#endif
+
+inline int minOfEightKeys(const uint64_t *keys) {
+#ifdef P3_HAVE_AVX2_SELECT
+    if (hasAvx2())
+        return minOfEightKeysAvx2(keys);
+#endif
+    return minKeyScalar(keys, 8);
+}
+
+#endif //P3_MINKEYSELECT_H
@@ -0,0 +1,179 @@
+// Name: Phubeth Mettaprasert
+// File: NameArena.h
+// Date: May 27, 2022
+//The header file and the implementation of the NameArena class. Stores the
+// names of the waiting patients one after another in a single buffer owned
+// by a priority queue.
+//Purpose: Instead of one small allocation per patient name, names are
+//         appended to the end of the arena and referred to by their offset
+//         and length. Names of patients that leave the queue are only marked
+//         as dead. Once the dead bytes pass a configurable share of the
+//         arena, the owner compacts it by copying the live names into a
+//         second buffer that is kept around for the next compaction. Both
+//         buffers allocate from the std::pmr::memory_resource the arena is
+//         created with.
+
+#ifndef P3_NAMEARENA_H
+#define P3_NAMEARENA_H
+
+#include <cassert>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+class NameArena {
+public:
+    struct Ref {
+        uint32_t offset; //Where the name starts in the arena
+        uint32_t length; //The number of characters of the name
+    };
+
+    explicit NameArena(pmr::memory_resource * = pmr::get_default_resource());
+    // Constructor that initializes the NameArena class.
+    // preconditions: The memory resource outlives the arena.
+    // postconditions: Creates an empty arena that compacts once half of it
+    //                 is dead.
+
+    Ref add(string_view);
+    // Appends the name to the end of the arena.
+    // preconditions: The arena stays below 4 GB.
+    // postconditions: Returns the reference to the copy of the name.
+
+    string_view view(Ref) const;
+    // Returns the characters of the name without copying them. The view is
+    // valid until the arena grows or is compacted.
+    // preconditions: The reference was returned by add and is still live.
+    // postconditions: none
+
+    void release(Ref);
+    // Marks the bytes of the name as dead so the next compaction drops them.
+    // The characters stay readable until then.
+    // preconditions: The reference was returned by add and is still live.
+    // postconditions: none
+
+    bool needsCompaction() const;
+    // Returns true once the dead bytes pass the compaction threshold.
+    // preconditions: none
+    // postconditions: none
+
+    template <class ForEachLiveRef>
+    void compact(ForEachLiveRef);
+    // Copies every live name into the spare buffer and swaps the buffers.
+    // The argument is called with a function that has to be called on every
+    // live reference, which moves the name and updates the reference.
+    // preconditions: Every live reference is passed exactly once.
+    // postconditions: There are no dead bytes left in the arena.
+
+    void setCompactionThreshold(double);
+    // Sets the share of the arena, between 0 and 1, that has to be dead
+    // before needsCompaction returns true.
+    // preconditions: none
+    // postconditions: none
+
+    void shrinkToFit();
+    // Frees the spare buffer and the unused capacity of the arena, such as
+    // after compacting it once a surge of patients has left.
+    // preconditions: none
+    // postconditions: The arena only holds the bytes of its names.
+
+    size_t liveBytes() const;
+    // Returns the number of bytes of names that are still live.
+    // preconditions: none
+    // postconditions: none
+
+    size_t deadBytes() const;
+    // Returns the number of bytes of names that were released.
+    // preconditions: none
+    // postconditions: none
+
+    size_t capacityBytes() const;
+    // Returns the number of bytes the arena has allocated for names,
+    // including the spare buffer used by compaction.
+    // preconditions: none
+    // postconditions: none
+
+private:
+
+    static const size_t MIN_COMPACTION_BYTES = 4096; //Too small to bother
+
+    pmr::vector<char> buffer; //The names, one after another
+    pmr::vector<char> spare; //The buffer the next compaction copies into
+    size_t dead; //The number of bytes of released names in the buffer
+    double threshold; //The share of dead bytes that triggers compaction
+};
+
+NameArena::NameArena(pmr::memory_resource *resource)
+        : buffer(resource), spare(resource) {
+
+    //Compact once half of the arena is dead
+    dead = 0;
+    threshold = 0.5;
+}
+
+NameArena::Ref NameArena::add(string_view name) {
+    assert(buffer.size() + name.size() <= UINT32_MAX);
+
+    //The name goes at the end of the buffer
+    Ref ref = {(uint32_t) buffer.size(), (uint32_t) name.size()};
+    buffer.insert(buffer.end(), name.begin(), name.end());
+    return ref;
+}
+
+string_view NameArena::view(Ref ref) const {
+    return string_view(buffer.data() + ref.offset, ref.length);
+}
+
+void NameArena::release(Ref ref) {
+
+    //The bytes are only reclaimed by the next compaction
+    dead += ref.length;
+}
+
+bool NameArena::needsCompaction() const {
+    return dead >= MIN_COMPACTION_BYTES && dead >= threshold * buffer.size();
+}
+
+template <class ForEachLiveRef>
+void NameArena::compact(ForEachLiveRef forEachLiveRef) {
+    spare.clear();
+    spare.reserve(buffer.size() - dead);
+
+    //Copy each live name to the end of the spare buffer
+    forEachLiveRef([this](Ref &ref) {
+        uint32_t offset = spare.size();
+        spare.insert(spare.end(), buffer.begin() + ref.offset,
+                     buffer.begin() + ref.offset + ref.length);
+        ref.offset = offset;
+    });
+
+    //The old buffer becomes the spare for the next compaction
+    buffer.swap(spare);
+    dead = 0;
+}
+
+void NameArena::setCompactionThreshold(double threshold) {
+    this->threshold = threshold;
+}
+
+void NameArena::shrinkToFit() {
+    buffer.shrink_to_fit();
+    pmr::vector<char>(spare.get_allocator()).swap(spare);
+}
+
+size_t NameArena::liveBytes() const {
+    return buffer.size() - dead;
+}
+
+size_t NameArena::deadBytes() const {
+    return dead;
+}
+
+size_t NameArena::capacityBytes() const {
+    return buffer.capacity() + spare.capacity();
+}
+
+#endif //P3_NAMEARENA_H
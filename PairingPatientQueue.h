@@ -0,0 +1,243 @@
+// Name: Phubeth Mettaprasert
+// File: PairingPatientQueue.h
+// Date: May 27, 2022
+//The header file and the implementation of the PairingPatientQueue. An
+// engine for the triage system (see PatientQueueEngine.h) that stores the
+// Patient objects in a pairing heap of linked nodes instead of a vector.
+//Purpose: A pairing heap adds a Patient in constant time by linking it with
+//         the root, and only does the work of ordering the Patients when the
+//         root is removed, by pairing up the children of the old root. Nodes
+//         are ordered by the packed order key of their Patient.
+
+#ifndef P3_PAIRINGPATIENTQUEUE_H
+#define P3_PAIRINGPATIENTQUEUE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cassert>
+#include "Patient.h"
+
+using namespace std;
+
+class PairingPatientQueue {
+public:
+    PairingPatientQueue();
+    // Constructor that initializes the PairingPatientQueue class.
+    // preconditions: none
+    // postconditions: Sets the arrivalOrder to zero and the heap to empty.
+
+    ~PairingPatientQueue();
+    // Destructor that deletes every node still in the heap.
+    // preconditions: none
+    // postconditions: none
+
+    PairingPatientQueue(const PairingPatientQueue &) = delete;
+    PairingPatientQueue &operator=(const PairingPatientQueue &) = delete;
+    // The nodes are owned by one queue, so the queue cannot be copied.
+
+    void add(string, int);
+    // A method to add a Patient object to the heap by linking a new node
+    // with the root.
+    // preconditions: none
+    // postconditions: A Patient object will be added to the heap.
+
+    Patient remove();
+    // A method to remove the highest priority Patient object, which is the
+    // root. The children of the root are paired up into the new root.
+    // preconditions: The heap must not be empty.
+    // postconditions: The root Patient will be removed from the heap and
+    //                 moved out to the caller.
+
+    const Patient &peek() const;
+    // Returns the highest priority patient without removing or copying the
+    // patient. The reference is valid until the queue is changed.
+    // preconditions: The heap must not be empty.
+    // postconditions: none
+
+    int size();
+    // Returns the number of patients still waiting.
+    // preconditions: none
+    // postconditions: none
+
+    string to_string() const;
+    // Returns the string represation of the object with every node listed
+    // before its children.
+    // preconditions: none. The heap can be empty.
+    // postconditions: none
+
+private:
+
+    struct Node {
+        uint64_t key; //The order key of the Patient
+        Patient patient; //The Patient stored in the node
+        Node *child; //The first child of the node
+        Node *sibling; //The next child of the parent of the node
+    };
+
+    int arrivalOrderNo; //A private variable to keep track of the arrival order
+    int nextPatientNumber; //The number of nodes in the heap
+    Node *root; //The node of the highest priority Patient
+
+    static Node *link(Node *, Node *);
+    // A method that assists the add and remove methods. Makes the root with
+    // the larger key the first child of the other root.
+    // preconditions: Both nodes are roots of heaps. Either can be null.
+    // postconditions: Returns the root of the linked heap.
+
+    static Node *pairChildren(Node *);
+    // A method that assists the remove method. Links the children of the
+    // removed root in pairs from left to right, and then links the pairs
+    // together from right to left.
+    // preconditions: The node is the first of a list of siblings or null.
+    // postconditions: Returns the root of the heap made of all the siblings.
+
+    bool empty() const;
+    // A method to check if the heap is empty. Returns true if it is.
+    // preconditions: none
+    // postconditions: none
+};
+
+PairingPatientQueue::PairingPatientQueue() {
+
+    //Starts the arrival order number and the patient number at zero.
+    arrivalOrderNo = 0;
+    nextPatientNumber = 0;
+    root = nullptr;
+}
+
+PairingPatientQueue::~PairingPatientQueue() {
+
+    //Delete the nodes with a stack of nodes still to visit, since the tree
+    // can be too deep to walk with recursion
+    vector<Node *> toDelete;
+    if (root != nullptr)
+        toDelete.push_back(root);
+    while (!toDelete.empty()) {
+        Node *node = toDelete.back();
+        toDelete.pop_back();
+        if (node->child != nullptr)
+            toDelete.push_back(node->child);
+        if (node->sibling != nullptr)
+            toDelete.push_back(node->sibling);
+        delete node;
+    }
+}
+
+void PairingPatientQueue::add(string name, int priorityCode) {
+
+    //A new node is a heap of one, linked with the root
+    Node *node = new Node{Patient::makeOrderKey(priorityCode, arrivalOrderNo),
+                          Patient(std::move(name), priorityCode,
+                                  arrivalOrderNo),
+                          nullptr, nullptr};
+    root = link(root, node);
+
+    //Increment the arrival order and the patient number
+    arrivalOrderNo++;
+    nextPatientNumber++;
+}
+
+PairingPatientQueue::Node *PairingPatientQueue::link(Node *first,
+                                                     Node *second) {
+    if (first == nullptr)
+        return second;
+    if (second == nullptr)
+        return first;
+
+    //The root with the smaller key stays the root
+    if (second->key < first->key) {
+        Node *temp = first;
+        first = second;
+        second = temp;
+    }
+    second->sibling = first->child;
+    first->child = second;
+    return first;
+}
+
+PairingPatientQueue::Node *PairingPatientQueue::pairChildren(Node *first) {
+
+    //First pass: link the siblings in pairs from left to right. The linked
+    // pairs are chained through their sibling pointer in reverse order.
+    Node *pairs = nullptr;
+    while (first != nullptr) {
+        Node *second = first->sibling;
+        Node *rest = second == nullptr ? nullptr : second->sibling;
+        first->sibling = nullptr;
+        if (second != nullptr)
+            second->sibling = nullptr;
+
+        Node *pair = link(first, second);
+        pair->sibling = pairs;
+        pairs = pair;
+        first = rest;
+    }
+
+    //Second pass: link the pairs from right to left into one heap
+    Node *result = nullptr;
+    while (pairs != nullptr) {
+        Node *rest = pairs->sibling;
+        pairs->sibling = nullptr;
+        result = link(result, pairs);
+        pairs = rest;
+    }
+    return result;
+}
+
+Patient PairingPatientQueue::remove() {
+    //Assert if it is empty
+    assert(!empty());
+
+    //Move the Patient of the root out and pair up its children
+    Node *oldRoot = root;
+    Patient temp = std::move(oldRoot->patient);
+    root = pairChildren(oldRoot->child);
+    delete oldRoot;
+
+    //Decrement
+    nextPatientNumber--;
+
+    //Return the old Patient object
+    return temp;
+}
+
+const Patient &PairingPatientQueue::peek() const {
+
+    //The root of the heap
+    assert(!empty());
+    return root->patient;
+}
+
+bool PairingPatientQueue::empty() const {
+
+    //Check if there are still Patients in the heap
+    return nextPatientNumber == 0;
+}
+
+string PairingPatientQueue::to_string() const {
+
+    //Print out every node before its children, children from left to right
+    string list;
+    vector<const Node *> toVisit;
+    if (root != nullptr)
+        toVisit.push_back(root);
+    while (!toVisit.empty()) {
+        const Node *node = toVisit.back();
+        toVisit.pop_back();
+        node->patient.appendTo(list);
+        if (node->sibling != nullptr)
+            toVisit.push_back(node->sibling);
+        if (node->child != nullptr)
+            toVisit.push_back(node->child);
+    }
+    return list;
+}
+
+int PairingPatientQueue::size() {
+
+    //returns the number of nodes in the heap
+    return nextPatientNumber;
+}
+
+#endif //P3_PAIRINGPATIENTQUEUE_H
@@ -1,9 +1,12 @@
 // Name: Phubeth Mettaprasert
-// File: PatientPriorityQueue.h
+// File: Patient.h
 // Date: May 27, 2022
 // The header file and the implementation of the Patient class. Contains
 // the framework to create Patient objects to be inserted into the
-// PatientPriorityQueue class.
+// PatientPriorityQueue class. The name is allocated through the
+// CharAllocator template parameter of BasicPatient: Patient uses the
+// default allocator and PmrPatient a std::pmr::memory_resource, such as the
+// one a queue for a whole simulation run allocates from.
 //Purpose: Creates a Patient object with the functionalities to compare with
 //         other Patient objects. Contains getter and to_string methods to be
 //         used in the PatientPriorityQueue.
@@ -11,19 +14,42 @@
 #ifndef P3_PATIENT_H
 #define P3_PATIENT_H
 
-#include <sstream>
+#include <charconv>
+#include <cstdint>
 #include <string>
-#include <iomanip>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include "PriorityTable.h"
 
 using namespace std;
 
-class Patient {
+template <class CharAllocator = allocator<char>>
+class BasicPatient {
 public:
-    Patient(string, int, int);
+    typedef CharAllocator allocator_type;
+    typedef basic_string<char, char_traits<char>, CharAllocator> NameString;
+
+    BasicPatient();
+    // Default constructor that creates an empty Patient. Used to fill the
+    // unused slots of containers that are sized ahead of time.
+    // preconditions: none
+    // postconditions: Creates a Patient with no name, priority code zero and
+    //                 arrival order zero.
+
+    BasicPatient(NameString, int, int);
     // Constructor that initializes the Patient class.
     // preconditions: none
     // postconditions: Takes in the name, takes in the priorityOrder and
     //                 takes in the arrivalOrder to create a Patient object.
+    //                 The name is moved in, so passing a temporary string
+    //                 does not allocate a second copy of it.
+
+    BasicPatient(string_view, int, int, const CharAllocator &);
+    // Constructor that copies the name into memory from the allocator, such
+    // as when a queue hands a Patient out of its own memory resource.
+    // preconditions: none
+    // postconditions: Same as the other constructor.
 
     string to_string() const;
     // A to_string method that returns the string of the information of the
@@ -31,7 +57,30 @@ public:
     // preconditions: none
     // postconditions: none
 
-    bool operator<(const Patient &);
+    static string to_string(string_view, int, int);
+    // Returns the same string as the to_string method for a name, priority
+    // code and arrival order that are not stored in a Patient object.
+    // preconditions: none
+    // postconditions: none
+
+    void appendTo(string &) const;
+    // Appends the same row as to_string to the end of the buffer, so many
+    // rows can be written into one buffer that is reused. Does not allocate
+    // once the buffer has room for the row.
+    // preconditions: none
+    // postconditions: The row is at the end of the buffer.
+
+    static void appendTo(string &, string_view, int, int);
+    // Appends the same row as the to_string method for a name, priority code
+    // and arrival order that are not stored in a Patient object.
+    // preconditions: none
+    // postconditions: The row is at the end of the buffer.
+
+    static const size_t ROW_WIDTH = 32;
+    // The number of characters of a row without the name, as long as the
+    // arrival number has at most 6 digits. Used to reserve room for rows.
+
+    bool operator<(const BasicPatient &);
     // An overloaded operator for the less than that allows for comparisons
     // between Patient objects.
     // preconditions: Requires another Patient object to be created as used
@@ -39,63 +88,213 @@ public:
     // postconditions: none
 
 
-    bool operator>(const Patient &);
+    bool operator>(const BasicPatient &);
     // An overloaded operator for the less than that allows for comparisons
     // between Patient objects.
     // preconditions: Requires another Patient object to be created as used
     //                as the argument for comparison.
     // postconditions: none
 
-    Patient &operator=(const Patient &);
+    BasicPatient(const BasicPatient &);
+    // Copy constructor that copies every attribute of the other Patient.
+    // preconditions: Requires another Patient object to be copied.
+    // postconditions: none
+
+    BasicPatient(BasicPatient &&) noexcept;
+    // Move constructor that takes over the name of the other Patient
+    // instead of copying it.
+    // preconditions: Requires another Patient object to be moved from.
+    // postconditions: The other Patient is left with an empty name.
+
+    BasicPatient &operator=(const BasicPatient &);
     // An overloaded operator for the = that copies the Patient object
     // inputted and returns reference to the current Patient object
     // preconditions: Requires another Patient object to be created as used
     //                as the argument for copying.
     // postconditions: none
 
-    string getPatientName() const;
+    BasicPatient &operator=(BasicPatient &&) noexcept;
+    // An overloaded operator for the = that moves the Patient object
+    // inputted so the name string is not copied, and returns reference to
+    // the current Patient object
+    // preconditions: Requires another Patient object to be moved from.
+    // postconditions: The other Patient is left with an empty name.
+
+    NameString getPatientName() const &;
     // A getter method that returns the name of the patient. This is needed
     // as to not conflict with the format of the to_string for the class.
     // preconditions: none
     // postconditions: none
 
+    NameString getPatientName() &&;
+    // The getter method for a Patient that is about to be destroyed, such as
+    // the one returned by remove(). The name is moved out instead of copied.
+    // preconditions: none
+    // postconditions: The Patient is left with an empty name.
+
+    string_view getNameView() const;
+    // Returns the name of the patient without copying it, the same way as
+    // PatientRecord, so display code can read either one. The view is valid
+    // until the Patient is changed or destroyed.
+    // preconditions: none
+    // postconditions: none
+
+    int getPriorityCode() const;
+    // Returns the priority code of the patient, the same way as
+    // PatientRecord.
+    // preconditions: none
+    // postconditions: none
+
+    uint64_t getArrivalOrder() const;
+    // Returns the arrival order of the patient, starting at zero, the same
+    // way as PatientRecord.
+    // preconditions: none
+    // postconditions: none
+
+    uint64_t getOrderKey() const;
+    // Returns the priority code and arrival order packed into one key, so
+    // that comparing the keys of two Patients as integers gives the same
+    // order as operator<. Used by the priority queues to compare Patients
+    // without branching.
+    // preconditions: none
+    // postconditions: none
+
+    static uint64_t makeOrderKey(int, int);
+    // Packs a priority code and an arrival order into the same key that
+    // getOrderKey returns, before the Patient is created.
+    // preconditions: The priority code fits in 8 bits and the arrival order
+    //                is not negative.
+    // postconditions: none
+
+    void setPriorityCode(int);
+    // A setter method used when a patient is re-triaged with a new priority
+    // code. The arrival order of the patient does not change.
+    // preconditions: none
+    // postconditions: The Patient will have the new priority code.
+
+    void setArrivalOrder(int);
+    // A setter method for a queue that creates the Patient before it knows
+    // the arrival order, such as one that builds the Patient outside of its
+    // lock and numbers it once it holds the lock.
+    // preconditions: The Patient is not in a queue yet.
+    // postconditions: The Patient will have the arrival order.
+
     string getPriorityInString() const;
     // Returns the string of the priority code from an int that was stored
     // when creating the Patient object.
     // preconditions: none
     // postconditions: none
 
+    static string getPriorityInString(int);
+    // Returns the string of any priority code, or an empty string if the
+    // code is not one of the four codes.
+    // preconditions: none
+    // postconditions: none
+
 
 
 private:
-    string name; //Store the name of the patient
+    NameString name; //Store the name of the patient
     int priorityCode; //Store the priority code of the patient
     int arrivalOrder; //Store the arrival order of the patient
 };
 
-Patient::Patient(string name, int priorityCode, int arrivalOrder) {
+template <class CharAllocator>
+BasicPatient<CharAllocator>::BasicPatient() {
+
+    //An empty Patient that is never called by the priority queues.
+    this->priorityCode = 0;
+    this->arrivalOrder = 0;
+}
+
+template <class CharAllocator>
+BasicPatient<CharAllocator>::BasicPatient(NameString name, int priorityCode,
+                                          int arrivalOrder)
+        : name(std::move(name)) {
 
     //Constructor that sets the private attributes by the arguments put in.
-    this->name = name;
+    // The name was already moved in above.
+    this->priorityCode = priorityCode;
+    this->arrivalOrder = arrivalOrder;
+}
+
+template <class CharAllocator>
+BasicPatient<CharAllocator>::BasicPatient(string_view name, int priorityCode,
+                                          int arrivalOrder,
+                                          const CharAllocator &allocator)
+        : name(name, allocator) {
     this->priorityCode = priorityCode;
     this->arrivalOrder = arrivalOrder;
 }
 
 
-string Patient::to_string() const {
+template <class CharAllocator>
+string BasicPatient<CharAllocator>::to_string() const {
+    return to_string(name, priorityCode, arrivalOrder);
+}
 
-    //Create the stringstream object.
-    stringstream ss;
+template <class CharAllocator>
+string BasicPatient<CharAllocator>::to_string(string_view name,
+                                            int priorityCode,
+                                            int arrivalOrder) {
 
-    //Store the string in the string stream object. Reason for +1 was to
-    // start the arrival order at 1 rather than at zero.
-    ss << setw(6) << (arrivalOrder + 1) << "          " << setw(15) << left <<
-       getPriorityInString() << left << name << "\n";
-    return ss.str();
+    //Build the row in a string of its own
+    string row;
+    appendTo(row, name, priorityCode, arrivalOrder);
+    return row;
 
 }
 
-Patient &Patient::operator=(const Patient &otherPatient) {
+template <class CharAllocator>
+void BasicPatient<CharAllocator>::appendTo(string &buffer) const {
+    appendTo(buffer, name, priorityCode, arrivalOrder);
+}
+
+template <class CharAllocator>
+void BasicPatient<CharAllocator>::appendTo(string &buffer, string_view name,
+                                           int priorityCode,
+                                           int arrivalOrder) {
+
+    //Reason for +1 was to start the arrival order at 1 rather than at zero.
+    // The number is right aligned in 6 characters.
+    char digits[16];
+    char *end = to_chars(digits, digits + sizeof(digits),
+                         arrivalOrder + 1).ptr;
+    size_t length = end - digits;
+    if (length < 6)
+        buffer.append(6 - length, ' ');
+    buffer.append(digits, length);
+    buffer.append(10, ' ');
+
+    //The priority is left aligned in 15 characters, followed by the name
+    string_view priority = getPriorityName(priorityCode);
+    buffer.append(priority.data(), priority.size());
+    buffer.append(15 - priority.size(), ' ');
+    buffer.append(name.data(), name.size());
+    buffer.push_back('\n');
+}
+
+template <class CharAllocator>
+BasicPatient<CharAllocator>::BasicPatient(const BasicPatient &otherPatient) {
+
+    //Copies the attributes of the other Patient object to be copied
+    name = otherPatient.name;
+    priorityCode = otherPatient.priorityCode;
+    arrivalOrder = otherPatient.arrivalOrder;
+}
+
+template <class CharAllocator>
+BasicPatient<CharAllocator>::BasicPatient(BasicPatient &&otherPatient) noexcept
+        : name(std::move(otherPatient.name)) {
+
+    //Only the name owns memory, the rest is just copied over
+    priorityCode = otherPatient.priorityCode;
+    arrivalOrder = otherPatient.arrivalOrder;
+}
+
+template <class CharAllocator>
+BasicPatient<CharAllocator> &
+BasicPatient<CharAllocator>::operator=(const BasicPatient &otherPatient) {
 
     //Copies the attributes of the other Patient object to be copied
     name = otherPatient.name;
@@ -104,7 +303,19 @@ Patient &Patient::operator=(const Patient &otherPatient) {
     return *this;
 }
 
-bool Patient::operator<(const Patient &right) {
+template <class CharAllocator>
+BasicPatient<CharAllocator> &
+BasicPatient<CharAllocator>::operator=(BasicPatient &&otherPatient) noexcept {
+
+    //Takes over the name of the other Patient instead of copying it
+    name = std::move(otherPatient.name);
+    priorityCode = otherPatient.priorityCode;
+    arrivalOrder = otherPatient.arrivalOrder;
+    return *this;
+}
+
+template <class CharAllocator>
+bool BasicPatient<CharAllocator>::operator<(const BasicPatient &right) {
 
     //Operator overloading function for the less than equal sign
     if (priorityCode < right.priorityCode) {
@@ -122,7 +333,8 @@ bool Patient::operator<(const Patient &right) {
 
 }
 
-bool Patient::operator>(const Patient &right) {
+template <class CharAllocator>
+bool BasicPatient<CharAllocator>::operator>(const BasicPatient &right) {
 
     //Operator overloading function for the less than equal sign
     if (priorityCode > right.priorityCode) {
@@ -141,30 +353,79 @@ bool Patient::operator>(const Patient &right) {
 }
 
 
-string Patient::getPatientName() const {
+template <class CharAllocator>
+typename BasicPatient<CharAllocator>::NameString
+BasicPatient<CharAllocator>::getPatientName() const & {
 
     //Just returns the name of the Patient object since to_string displays
     // another string.
     return name;
 }
 
-string Patient::getPriorityInString() const {
+template <class CharAllocator>
+typename BasicPatient<CharAllocator>::NameString
+BasicPatient<CharAllocator>::getPatientName() && {
+
+    //The Patient is a temporary so its name can be handed over
+    return std::move(name);
+}
+
+template <class CharAllocator>
+string_view BasicPatient<CharAllocator>::getNameView() const {
+    return name;
+}
+
+template <class CharAllocator>
+int BasicPatient<CharAllocator>::getPriorityCode() const {
+    return priorityCode;
+}
+
+template <class CharAllocator>
+uint64_t BasicPatient<CharAllocator>::getArrivalOrder() const {
+    return arrivalOrder;
+}
+
+template <class CharAllocator>
+uint64_t BasicPatient<CharAllocator>::getOrderKey() const {
+    return makeOrderKey(priorityCode, arrivalOrder);
+}
+
+template <class CharAllocator>
+uint64_t BasicPatient<CharAllocator>::makeOrderKey(int priorityCode,
+                                                   int arrivalOrder) {
+
+    //A lower priority code always wins, and the arrival order breaks ties
+    return ((uint64_t) priorityCode << 56) | (uint64_t) arrivalOrder;
+}
+
+template <class CharAllocator>
+void BasicPatient<CharAllocator>::setPriorityCode(int priorityCode) {
+
+    //Only the priority changes, the patient keeps their place in line
+    this->priorityCode = priorityCode;
+}
+
+template <class CharAllocator>
+void BasicPatient<CharAllocator>::setArrivalOrder(int arrivalOrder) {
+    this->arrivalOrder = arrivalOrder;
+}
+
+template <class CharAllocator>
+string BasicPatient<CharAllocator>::getPriorityInString() const {
+    return getPriorityInString(priorityCode);
+}
+
+template <class CharAllocator>
+string BasicPatient<CharAllocator>::getPriorityInString(int priorityCode) {
 
     //Returns the string of the priorityCode. Used to switch from the number
     // format to display the string format.
-    switch (this->priorityCode) {
-        case 1:
-            return "immediate";
-        case 2:
-            return "emergency";
-        case 3:
-            return "urgent";
-        case 4:
-            return "minimal";
-        default:
-            return "";
-
-    }
+    return string(getPriorityName(priorityCode));
 }
 
+typedef BasicPatient<> Patient; //A Patient with a std::string name
+
+//A Patient with its name in a std::pmr::memory_resource
+typedef BasicPatient<pmr::polymorphic_allocator<char>> PmrPatient;
+
 #endif //P3_PATIENT_H
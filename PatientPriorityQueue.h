@@ -6,53 +6,265 @@
 // objects.
 //Purpose: A class that will have different methods to add, manipulate and
 //         delete Patient objects from a PriorityQueue where the queue will
-//         maintain min heap order.
+//         maintain min heap order. The number of children of every node
+//         (the arity of the heap) is a template parameter, so a 4-ary or
+//         8-ary heap can be used for large queues to cut the depth of the
+//         tree. PatientPriorityQueue is the binary heap. The 8-ary heap
+//         finds the smallest child with AVX2 when the processor has it.
+//         The heap itself is stored as two vectors of the same length: the
+//         packed 64 bit ordering keys, and the slot of each Patient in a
+//         third vector. Sifting only reads the dense keys and moves keys
+//         and slots, so the names of the Patients are only touched when a
+//         Patient is peeked, removed or listed. The queue also keeps the
+//         heap index of every slot, so the slot works as a handle to cancel
+//         or re-triage a Patient that is not at the root. The names of the
+//         waiting Patients are kept in a PatientRecord of one cache line
+//         per slot, and names too long for the record spill to a NameArena
+//         owned by the queue. The records are kept in a
+//         RecordPool that recycles the slots of removed Patients, and every
+//         container of the queue allocates through the Allocator template
+//         parameter. Room can be reserved ahead of a surge, and once a surge
+//         drains the queue gives back its memory following a shrink policy
+//         that waits for the queue to fall well below its capacity, so a
+//         queue that goes up and down around one size does not reallocate.
+//         The heap arrays are vectors by default. The Storage template
+//         parameter can swap them for any vector-like container, and storage
+//         with a shrinkTo method gives memory back in place. The MappedArray
+//         of MappedPatientPriorityQueue.h is one, kept out of this header
+//         since it needs POSIX mmap.
+//         With a pmr allocator the name arena and the names of the Patients
+//         handed back come from the same memory resource as the heap, so a
+//         whole session can run out of one monotonic buffer.
 
 #ifndef P3_PATIENTPRIORITYQUEUE_H
 #define P3_PATIENTPRIORITYQUEUE_H
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <cassert>
+#include "MinKeySelect.h"
+#include "NameArena.h"
 #include "Patient.h"
+#include "PatientRecord.h"
+#include "RecordPool.h"
 
 using namespace std;
 
-class PatientPriorityQueue {
+//Asks for the cache line of an address ahead of its use, on the compilers
+// that can. Elsewhere, such as with MSVC, it does nothing.
+#if defined(__GNUC__) || defined(__clang__)
+#define P3_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define P3_PREFETCH(address) ((void) 0)
+#endif
+
+//Identifies a Patient that is still waiting in a BasicPatientPriorityQueue.
+// The slot of a Patient is handed out again once it leaves the queue, so the
+// handle also holds the arrival order of the Patient as a generation. No
+// other Patient of the queue gets the same arrival order, so a handle stops
+// being valid for good once its Patient leaves.
+struct PatientHandle {
+    int slot; //The slot of the record of the Patient in the record pool
+    uint32_t generation; //The arrival order of the Patient
+};
+
+//The memory held by a BasicPatientPriorityQueue, as told by memoryUsage
+struct MemoryUsage {
+    size_t heapBytes; //Allocated for the heap, the handles and the records
+    size_t nameBytes; //Allocated for names that spill to the name arena
+    size_t slackBytes; //The part of both not holding a waiting Patient
+};
+
+template <int Arity, class Allocator = allocator<PatientRecord>,
+          template <class, class> class Storage = vector>
+class BasicPatientPriorityQueue {
+    static_assert(Arity >= 2, "A heap node needs at least two children");
+
 public:
-    PatientPriorityQueue();
-    // Constructor that initializes the PatientPriorityQueue class.
+    //The Patient handed out by remove and cancel, with its name allocated
+    // through the allocator of the queue. Patient for the default allocator.
+    typedef BasicPatient<typename allocator_traits<Allocator>::template
+            rebind_alloc<char>> PatientType;
+
+    explicit BasicPatientPriorityQueue(const Allocator & = Allocator());
+    // Constructor that initializes the BasicPatientPriorityQueue class.
     // preconditions: none
-    // postconditions: Sets the arrivalOrder to zero.
+    // postconditions: Sets the arrivalOrder to zero. The containers of the
+    //                 queue allocate through copies of the allocator.
 
-    void add(string, int);
+    PatientHandle add(string_view, int);
     // A method to add a Patient object to the PriorityQueue. Heap order is
-    // maintained once the Patient is added.
+    // maintained once the Patient is added. The name is copied to the end
+    // of the name arena, which does not allocate once the arena is large
+    // enough.
     // preconditions: A vector that exists so that Patient can be added to
-    //                the queue.
+    //                the queue. The priority code is in the priority table.
     // postconditions: A Patient object will be added to the vector for the
-    //                 priority queue.
-
-    const Patient remove();
+    //                 priority queue. Returns the handle of the Patient.
+
+    template <class InputIterator>
+    void addRange(InputIterator, InputIterator);
+    // A method to add many Patient objects at once from a range of
+    // (name, priority code) pairs, such as a vector<pair<string, int>>. The
+    // Patients get their arrival order in the order of the range. When the
+    // range is at least as large as the queue, every Patient is appended
+    // first and heap order is restored bottom up in linear time instead of
+    // sifting each Patient up.
+    // preconditions: The range is made of (name, priority code) pairs whose
+    //                codes are in the priority table.
+    // postconditions: Every Patient of the range will be added to the vector
+    //                 for the priority queue.
+
+    PatientType remove();
     // A method to remove a Patient object to the PriorityQueue. Heap order is
-    // maintained once the Patient is removed.
+    // maintained once the Patient is removed. The Patient returned owns a
+    // copy of the name allocated through the allocator of the queue, and the
+    // name is released from the arena.
     // preconditions: A vector that exists so that Patient can be removed.
     //                The vector must not be empty as well.
     // postconditions: The Patient object at index 0 (min heap ordered) will be
     //                 removed from the vector for the priority queue.
 
-    const Patient peek() const;
-    // Returns the highest priority patient without removing the patient.
+    int removeN(int, vector<PatientType> &);
+    // A method to remove the given number of highest priority Patients at
+    // once, such as when a new shift of clinicians starts, and append them
+    // to the end of the buffer in the order remove would return them. A
+    // batch of at least three quarters of the queue, or of half a queue of
+    // at least 2^18 Patients, selects its Patients from a copy of the
+    // keys in linear time, sorts only the batch, reads the records of the
+    // batch ahead of use, and then rebuilds the heap from the entries left
+    // in linear time instead of sifting once for every Patient. A smaller
+    // batch pops the root that many times, which is faster for it.
+    // preconditions: The number is not negative.
+    // postconditions: Returns how many Patients were removed, which is fewer
+    //                 than asked for if the queue runs out. Heap order is
+    //                 maintained.
+
+    void pop();
+    // A method to remove the highest priority Patient without copying its
+    // name out, for callers that have already read it through peek or do
+    // not need it. Heap order is maintained once the Patient is removed.
+    // preconditions: The vector must not be empty.
+    // postconditions: The Patient object at index 0 will be removed from
+    //                 the vector for the priority queue.
+
+    optional<PatientType> cancel(PatientHandle);
+    // A method to remove the Patient of the handle wherever it is in the
+    // PriorityQueue, such as when a patient leaves without being seen. Heap
+    // order is maintained in O(log n) once the Patient is removed.
+    // preconditions: none
+    // postconditions: The Patient will be removed from the priority queue
+    //                 and moved out to the caller. Returns nothing and
+    //                 leaves the queue alone if the handle does not belong
+    //                 to a Patient that is still waiting.
+
+    bool changePriority(PatientHandle, int);
+    // A method to re-triage the Patient of the handle with a new priority
+    // code. The Patient keeps its arrival order and heap order is restored
+    // in O(log n).
+    // preconditions: The priority code is in the priority table.
+    // postconditions: The Patient will have the new priority code. Returns
+    //                 false and leaves the queue alone if the handle does
+    //                 not belong to a Patient that is still waiting.
+
+    void setNameCompactionThreshold(double);
+    // Sets the share of the name arena, between 0 and 1, that has to belong
+    // to removed patients before the live names are compacted. The default
+    // is 0.5. Compaction happens during the next add.
+    // preconditions: none
+    // postconditions: none
+
+    void reserve(int);
+    // Makes room for the number of Patients so adding up to that many does
+    // not allocate anything but spilled names. The queue never shrinks
+    // below the reserved number of Patients.
+    // preconditions: none
+    // postconditions: The queue has room for at least that many Patients.
+
+    void setShrinkPolicy(double, int);
+    // Sets when the queue gives back memory after Patients are removed: once
+    // the size falls below the share, between 0 and 1, of the most Patients
+    // that waited since the last shrink, and that peak is above the minimum
+    // number of Patients. The queue then shrinks to twice its size and
+    // starts a new peak, so it has to grow and drain that far again before
+    // the next shrink. The default is 0.25 and 1024, and a share of 0 turns
+    // shrinking off. The peak is used instead of the capacity because the
+    // capacity of storage that grows in whole pages cannot always shrink.
+    // preconditions: The share is below 0.5.
+    // postconditions: none
+
+    MemoryUsage memoryUsage() const;
+    // Returns the number of bytes allocated for the heap and the records,
+    // for spilled names, and how many of those are not in use.
+    // preconditions: none
+    // postconditions: none
+
+    PoolStats recordPoolStats() const;
+    // Returns the statistics of the pool of PatientRecords, such as how many
+    // slabs it has allocated and how many records were recycled.
+    // preconditions: none
+    // postconditions: none
+
+    bool contains(PatientHandle) const;
+    // Returns true if the handle belongs to a Patient that is still waiting,
+    // and false for the handle of a Patient that has left even once its slot
+    // holds another Patient.
+    // preconditions: none
+    // postconditions: none
+
+    const PatientRecord &peek() const;
+    // Returns the highest priority patient without removing or copying the
+    // patient. The reference and the name view of the record are valid
+    // until the queue is changed.
     // preconditions: A vector that exists so that Patient can be peeked.
     //                The vector must not be empty as well.
     // postconditions: none
 
+    class const_iterator;
+
+    template <class Visitor>
+    void forEach(Visitor) const;
+    // Calls the visitor with a const reference to the PatientRecord of every
+    // waiting patient in heap or level order, the same order as to_string,
+    // without copying any of them.
+    // preconditions: The visitor does not change the queue.
+    // postconditions: none
+
+    const_iterator begin() const;
+    // Returns an iterator to the first patient in heap or level order. The
+    // iterators give const references to PatientRecords and are valid until
+    // the queue is changed.
+    // preconditions: none
+    // postconditions: none
+
+    const_iterator end() const;
+    // Returns the iterator past the last patient in heap or level order.
+    // preconditions: none
+    // postconditions: none
+
 
     int size();
     // Returns the number of patients still waiting.
     // preconditions: A vector that exists so the size function can be called.
     // postconditions: none
 
+    void appendTo(string &) const;
+    // Appends the row of every waiting patient in heap or level order to
+    // the end of the buffer. The buffer can be cleared and reused for the
+    // next list, which then does not allocate unless the list is longer.
+    // preconditions: none
+    // postconditions: The rows are at the end of the buffer.
+
     string to_string() const;
     // Returns the string represation of the object in heap or level order.
     // preconditions: A vector that exists so the to_string method can be
@@ -63,11 +275,148 @@ public:
 private:
 
     int arrivalOrderNo; //A private variable to keep track of the arrival order
-    vector<Patient> Patients; //The vector for the priority queue
+
+    typedef allocator_traits<Allocator> Traits;
+    typedef typename Traits::template rebind_alloc<uint64_t> KeyAllocator;
+    typedef typename Traits::template rebind_alloc<int> IndexAllocator;
+    typedef typename Traits::template rebind_alloc<char> CharAllocator;
+
+    //Destroys the name arena and gives its memory back to the resource it
+    // was allocated from
+    struct NameArenaDeleter {
+        pmr::memory_resource *resource; //Where the arena was allocated
+
+        void operator()(NameArena *) const;
+    };
+
+    Allocator allocator; //Copied into every container and Patient handed out
+
+    //The heap: priority code in the top byte of a key, arrival order below
+    Storage<uint64_t, KeyAllocator> keys;
+    Storage<int, IndexAllocator> slots; //Slot of the Patient for each key
+    RecordPool<PatientRecord, Allocator> Patients; //Indexed by their slot
+    //The names of the Patients that are waiting
+    unique_ptr<NameArena, NameArenaDeleter> names;
+    Storage<int, IndexAllocator> positions; //Heap index of each slot, or -1
 
     //Keeps track of the size of the vector if I am understanding it correctly
     int nextPatientNumber;
 
+    double shrinkThreshold; //The share of the capacity in use to shrink at
+    int minimumCapacity; //The capacity the queue never shrinks below
+    int reservedCapacity; //The largest number of Patients reserved for
+    int peakSize; //The most Patients waiting since the last shrink
+
+    //An entry of the heap that may be in a removeN batch
+    struct Candidate {
+        uint64_t key; //The key of the entry, copied so it is read in order
+        int index; //Where the entry is in the heap
+    };
+    typedef typename Traits::template rebind_alloc<Candidate>
+            CandidateAllocator;
+
+    //The key removeN marks the entries of a batch with, which has a priority
+    // code of 255 that no Patient can have
+    static constexpr uint64_t PICKED_KEY = UINT64_MAX;
+
+    //The size from which removeN selects a batch of half the queue. Below
+    // it the keys and slots fit in the cache and popping the root was
+    // measured to be as fast, while at 500000 selecting took a quarter less.
+    static constexpr int SELECT_MIN_PATIENTS = 1 << 18;
+
+    //The keys copied out by removeN, kept so large batches do not allocate
+    vector<Candidate, CandidateAllocator> candidates;
+
+    int storePatient(string_view, int);
+    // A method that assists the add methods. Creates the Patient and appends
+    // its key and slot to the end of the heap without sifting.
+    // preconditions: none
+    // postconditions: Returns the index of the new entry, which might break
+    //                 the min heap order until it is sifted.
+
+    template <class OtherAllocator>
+    static pmr::memory_resource *memoryResourceOf(const OtherAllocator &);
+    // A method that assists the constructor. Returns the new and delete
+    // resource for the name arena to allocate from, since only a pmr
+    // allocator has a resource of its own.
+    // preconditions: none
+    // postconditions: none
+
+    template <class T>
+    static pmr::memory_resource *memoryResourceOf(
+            const pmr::polymorphic_allocator<T> &);
+    // Same as above, but returns the resource of the pmr allocator.
+
+    static NameArena *newNameArena(pmr::memory_resource *);
+    // A method that assists the constructor. Creates a name arena in memory
+    // from the resource, which is also where the arena allocates its names.
+    // preconditions: none
+    // postconditions: Returns the arena, which NameArenaDeleter destroys.
+
+    void compactNames();
+    // A method that assists the add methods. Compacts the name arena by
+    // moving the names of every waiting Patient to the front of the arena.
+    // preconditions: none
+    // postconditions: The arena has no dead bytes left.
+
+    void shrink(int);
+    // A method that assists the remove methods. Brings the heap storage down
+    // to the capacity, gives back the record slabs that have no waiting
+    // Patient, compacts the name arena and frees the keys copied out by
+    // removeN.
+    // preconditions: The capacity is at least the size of the queue.
+    // postconditions: The heap has the capacity.
+
+    template <class Vector>
+    static void setCapacity(Vector &, int);
+    // A method that assists the shrink method. Brings the storage down to
+    // the capacity, in place when the storage can shrink itself.
+    // preconditions: The capacity is at least the size of the vector.
+    // postconditions: The vector has at least the capacity.
+
+    template <class Vector>
+    static auto setCapacity(Vector &, int, int)
+            -> decltype(declval<Vector &>().shrinkTo(0), void());
+    // A method that assists the setCapacity method. Chosen for storage with a
+    // shrinkTo method, such as a MappedArray, which gives the pages past the
+    // capacity back without a copy.
+    // preconditions: The capacity is at least the size of the storage.
+    // postconditions: The storage has the capacity rounded up to a page.
+
+    template <class Vector>
+    static void setCapacity(Vector &, int, long);
+    // A method that assists the setCapacity method. Copies the vector into
+    // one of the capacity, since shrink_to_fit can only shrink to the size.
+    // preconditions: The capacity is at least the size of the vector.
+    // postconditions: The vector has the capacity.
+
+    void setEntry(int, uint64_t, int);
+    // A method that assists the sift methods. Writes the key and slot into
+    // the heap index and remembers the index as the position of the slot.
+    // preconditions: The heap index is in bounds of the vector.
+    // postconditions: none
+
+    void removeAt(int);
+    // A method that assists the remove, pop and cancel methods. Removes the
+    // entry at the heap index by moving the last entry into it and sifting
+    // it. The name of the Patient stays readable until the next add, unless
+    // the removal shrinks the queue.
+    // preconditions: The heap index is in bounds of the vector.
+    // postconditions: Heap order is maintained.
+
+    void shrinkIfDrained();
+    // A method that assists the remove methods. Shrinks the queue once it
+    // has drained far enough below its peak for the shrink policy.
+    // preconditions: none
+    // postconditions: The peak starts over if the queue shrinks.
+
+    void heapify();
+    // A method that assists the addRange and removeN methods. Restores the
+    // min heap order of the whole vector by sifting down every parent from
+    // the last one up to the root, which takes linear time.
+    // preconditions: none
+    // postconditions: The vector will be in min heap order.
+
     void siftUp(int);
     // A method that assists the add method. This method is called in order
     // to preserve the min heap order when adding a new value to the vector.
@@ -91,14 +440,17 @@ private:
     // postconditions: none
 
     int getLeftChild(int) const;
-    // A method to get the left child index of the current node.
+    // A method to get the index of the first (leftmost) child of the current
+    // node.
     // preconditions: A vector that exists so the getLeftChild method can be
     //                called.
     // postconditions: none
 
     int getRightChild(int) const;
-    // A method to get the right child index of the current node.
-    // preconditions: A vector that exists so the getLeftChild method can be
+    // A method to get the index of the last (rightmost) child of the current
+    // node. The children of a node are the indexes from getLeftChild to
+    // getRightChild, which sit next to each other in the vector.
+    // preconditions: A vector that exists so the getRightChild method can be
     //                called.
     // postconditions: none
 
@@ -110,154 +462,710 @@ private:
 
 };
 
-PatientPriorityQueue::PatientPriorityQueue() {
+//A read only forward iterator over the waiting patients of a queue in heap
+// or level order
+template <int Arity, class Allocator, template <class, class> class Storage>
+class BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator {
+public:
+    typedef forward_iterator_tag iterator_category;
+    typedef PatientRecord value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const PatientRecord *pointer;
+    typedef const PatientRecord &reference;
+
+    const_iterator(const BasicPatientPriorityQueue *, int);
+    // Constructor that initializes the const_iterator class.
+    // preconditions: The heap index is at most the size of the queue.
+    // postconditions: Points at the patient at the heap index.
+
+    reference operator*() const;
+    // Returns the record of the patient.
+    // preconditions: The iterator is not the end.
+    // postconditions: none
+
+    pointer operator->() const;
+    // Returns a pointer to the record of the patient.
+    // preconditions: The iterator is not the end.
+    // postconditions: none
+
+    const_iterator &operator++();
+    // Moves to the next patient in heap order.
+    // preconditions: The iterator is not the end.
+    // postconditions: none
+
+    const_iterator operator++(int);
+    // Moves to the next patient in heap order and returns the old iterator.
+    // preconditions: The iterator is not the end.
+    // postconditions: none
+
+    bool operator==(const const_iterator &) const;
+    // Returns true if both iterators point at the same heap index.
+    // preconditions: Both iterators belong to the same queue.
+    // postconditions: none
+
+    bool operator!=(const const_iterator &) const;
+    // Returns true if the iterators point at different heap indexes.
+    // preconditions: Both iterators belong to the same queue.
+    // postconditions: none
+
+private:
+    const BasicPatientPriorityQueue *queue; //The queue that is iterated
+    int index; //The heap index of the patient
+};
+
+typedef BasicPatientPriorityQueue<2> PatientPriorityQueue; //The binary heap
+
+//A heap that allocates everything, including the names of the Patients it
+// hands out, from a std::pmr::memory_resource given to the constructor
+template <int Arity>
+using PmrPatientPriorityQueue =
+        BasicPatientPriorityQueue<Arity,
+                                  pmr::polymorphic_allocator<PatientRecord>>;
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::BasicPatientPriorityQueue(
+        const Allocator &allocator)
+        : allocator(allocator), keys(KeyAllocator(allocator)),
+          slots(IndexAllocator(allocator)), Patients(allocator),
+          names(newNameArena(memoryResourceOf(allocator)),
+                NameArenaDeleter{memoryResourceOf(allocator)}),
+          positions(IndexAllocator(allocator)),
+          candidates(CandidateAllocator(allocator)) {
 
     //Starts the arrival order number at zero.
     arrivalOrderNo = 0;
 
     //Starts the nextPatientNumber at zero
     nextPatientNumber = 0;
+
+    //Shrinks once a queue above 1024 Patients drains to a quarter
+    shrinkThreshold = 0.25;
+    minimumCapacity = 1024;
+    reservedCapacity = 0;
+    peakSize = 0;
 }
 
-void PatientPriorityQueue::add(string name, int priorityCode) {
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class OtherAllocator>
+pmr::memory_resource *
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::memoryResourceOf(
+        const OtherAllocator &) {
+    return pmr::new_delete_resource();
+}
 
-    //Create a new Patient object
-    Patient newPatient(name, priorityCode, arrivalOrderNo);
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class T>
+pmr::memory_resource *
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::memoryResourceOf(
+        const pmr::polymorphic_allocator<T> &allocator) {
+    return allocator.resource();
+}
 
-    //Pushes the Patient object to the end of the vector
-    Patients.push_back(newPatient);
+template <int Arity, class Allocator, template <class, class> class Storage>
+NameArena *BasicPatientPriorityQueue<Arity, Allocator, Storage>::newNameArena(
+        pmr::memory_resource *resource) {
+    void *memory = resource->allocate(sizeof(NameArena), alignof(NameArena));
+    return new (memory) NameArena(resource);
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::NameArenaDeleter::
+operator()(NameArena *arena) const {
+    arena->~NameArena();
+    resource->deallocate(arena, sizeof(NameArena), alignof(NameArena));
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+PatientHandle BasicPatientPriorityQueue<Arity, Allocator, Storage>::add(
+        string_view name, int priorityCode) {
 
     //Calls siftUp to heapify inserting the index at size -1
-    siftUp(Patients.size() - 1);
+    int index = storePatient(name, priorityCode);
+    PatientHandle handle = {slots[index], (uint32_t) (arrivalOrderNo - 1)};
+    siftUp(index);
+    return handle;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class InputIterator>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::addRange(
+        InputIterator first, InputIterator last) {
+    int oldSize = nextPatientNumber;
+    for (; first != last; ++first)
+        storePatient((*first).first, (*first).second);
+
+    //Sifting every new Patient up costs O(m log n), so only heapify the
+    // whole vector in O(n) when the range is at least as large as the queue.
+    int added = nextPatientNumber - oldSize;
+    if (added >= oldSize) {
+        heapify();
+    } else {
+        for (int index = oldSize; index < nextPatientNumber; index++)
+            siftUp(index);
+    }
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+int BasicPatientPriorityQueue<Arity, Allocator, Storage>::storePatient(
+        string_view name, int priorityCode) {
+
+    //The AVX2 siftDown of the 8-ary heap compares keys as signed, so a code
+    // outside the table would give it the wrong child
+    assert(isPriorityCode(priorityCode));
+
+    //Drop the names of removed Patients before the arena grows any more
+    if (names->needsCompaction())
+        compactNames();
+
+    //Create a new Patient record, which spills a long name to the arena
+    PatientRecord newPatient(name, priorityCode, arrivalOrderNo, *names);
+
+    //The pool reuses the slot of a removed Patient before growing, and new
+    // slots are handed out in order
+    int slot = Patients.acquire();
+    Patients[slot] = newPatient;
+    if (slot == (int) positions.size())
+        positions.push_back(-1);
+
+    //Pushes the key and slot of the Patient to the end of the heap
+    keys.push_back(Patient::makeOrderKey(priorityCode, arrivalOrderNo));
+    slots.push_back(slot);
+    positions[slot] = nextPatientNumber;
 
     //Increment the arrival order for next patient to be added.
     arrivalOrderNo++;
 
     //Increment the patient number
     nextPatientNumber++;
+    if (nextPatientNumber > peakSize)
+        peakSize = nextPatientNumber;
+
+    //The index of the new entry at the end of the heap
+    return nextPatientNumber - 1;
+}
 
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::compactNames() {
+
+    //Every slot in the heap belongs to a waiting Patient, but only the
+    // spilled names are in the arena
+    names->compact([this](auto relocate) {
+        for (int i = 0; i < nextPatientNumber; i++) {
+            PatientRecord &record = Patients[slots[i]];
+            if (record.hasSpilledName()) {
+                NameArena::Ref ref = record.getNameRef();
+                relocate(ref);
+                record.setNameRef(ref);
+            }
+        }
+    });
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::
+setNameCompactionThreshold(double threshold) {
+    names->setCompactionThreshold(threshold);
 }
 
-void PatientPriorityQueue::siftUp(int index) {
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::reserve(
+        int capacity) {
+    keys.reserve(capacity);
+    slots.reserve(capacity);
+    positions.reserve(capacity);
+    Patients.reserve(capacity);
+    if (capacity > reservedCapacity)
+        reservedCapacity = capacity;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::setShrinkPolicy(
+        double threshold, int minimum) {
+    shrinkThreshold = threshold;
+    minimumCapacity = minimum;
+}
 
-    int parentIndex;
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::shrink(
+        int capacity) {
+    setCapacity(keys, capacity);
+    setCapacity(slots, capacity);
+
+    //The pool frees the slabs with no waiting Patient, and forgets the slots
+    // of the ones at the end
+    Patients.trim();
+    int used = Patients.slotCount();
+    positions.resize(used);
+    setCapacity(positions, max(used, reservedCapacity));
+
+    //Move the names that are left to the front of a smaller arena
+    compactNames();
+    names->shrinkToFit();
+
+    //The keys copied out by the last large removeN are not needed any more
+    vector<Candidate, CandidateAllocator>(candidates.get_allocator())
+            .swap(candidates);
+}
 
-    //Make it is not root node or index at zero
-    if (index != 0) {
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class Vector>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::setCapacity(
+        Vector &entries, int capacity) {
+    //The int argument prefers shrinkTo to the copy when the storage has it
+    setCapacity(entries, capacity, 0);
+}
 
-        //Find the parent index from the index given
-        parentIndex = getParent(index);
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class Vector>
+auto BasicPatientPriorityQueue<Arity, Allocator, Storage>::setCapacity(
+        Vector &entries, int capacity, int)
+        -> decltype(declval<Vector &>().shrinkTo(0), void()) {
+    entries.shrinkTo(capacity);
+}
 
-        //Does the min heap comparison and swapping
-        if (Patients[parentIndex] > Patients[index]) {
-            Patient temp = Patients[parentIndex];
-            Patients[parentIndex] = Patients[index];
-            Patients[index] = temp;
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class Vector>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::setCapacity(
+        Vector &entries, int capacity, long) {
+    Vector resized(entries.get_allocator());
+    resized.reserve(capacity);
+    resized.assign(entries.begin(), entries.end());
+    entries.swap(resized);
+}
 
-            //Recursively call siftUp until heap order is maintained or
-            // the current index gets to zero or the root node.
-            siftUp(parentIndex);
-        }
+template <int Arity, class Allocator, template <class, class> class Storage>
+MemoryUsage BasicPatientPriorityQueue<Arity, Allocator, Storage>::memoryUsage()
+        const {
+    MemoryUsage usage;
+    usage.heapBytes = keys.capacity() * sizeof(uint64_t) +
+                      slots.capacity() * sizeof(int) +
+                      positions.capacity() * sizeof(int) +
+                      candidates.capacity() * sizeof(Candidate) +
+                      Patients.allocatedBytes();
+    usage.nameBytes = names->capacityBytes();
+
+    //Each waiting Patient uses a key, a slot, a position and a record
+    size_t perPatient = sizeof(uint64_t) + 2 * sizeof(int) +
+                        sizeof(PatientRecord);
+    size_t inUse = nextPatientNumber * perPatient + names->liveBytes();
+    usage.slackBytes = usage.heapBytes + usage.nameBytes - inUse;
+    return usage;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::heapify() {
+
+    //The leaves are already heaps, so start at the parent of the last entry
+    if (nextPatientNumber > 1) {
+        for (int index = getParent(nextPatientNumber - 1); index >= 0;
+             index--)
+            siftDown(index);
+    }
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::siftUp(int index) {
+
+    //Take the entry out and leave a hole at its index
+    uint64_t movingKey = keys[index];
+    int movingSlot = slots[index];
+
+    //Move the hole up while the parent comes after the moving entry.
+    // The parent moves down into the hole instead of being swapped.
+    while (index != 0) {
+        int parentIndex = getParent(index);
+        if (keys[parentIndex] <= movingKey)
+            break;
+        setEntry(index, keys[parentIndex], slots[parentIndex]);
+        index = parentIndex;
     }
+
+    //Write the entry once into where the hole ended up
+    setEntry(index, movingKey, movingSlot);
 }
 
 
-int PatientPriorityQueue::getParent(int index) const {
+template <int Arity, class Allocator, template <class, class> class Storage>
+int BasicPatientPriorityQueue<Arity, Allocator, Storage>::getParent(
+        int index) const {
 
     //Formula to find the parent index in the vector
-    return (index - 1) / 2;
+    return (index - 1) / Arity;
 }
 
 
-void PatientPriorityQueue::siftDown(int index) {
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::siftDown(int index) {
 
-    //Finds the left and right index
+    //Take the entry out and leave a hole at its index
+    uint64_t movingKey = keys[index];
+    int movingSlot = slots[index];
+
+    //Finds the first and last child index
     int leftIndex, rightIndex, minIndex;
     leftIndex = getLeftChild(index);
-    rightIndex = getRightChild(index);
-
-    //See if the index are still in bounds of the priority queue
-    if (rightIndex >= nextPatientNumber) {
-        if (leftIndex >= nextPatientNumber)
-            return;
+    while (leftIndex < nextPatientNumber) {
+        rightIndex = getRightChild(index);
+        if (rightIndex >= nextPatientNumber)
+            rightIndex = nextPatientNumber - 1;
+
+        //Scan the children, which are next to each other in the vector, to
+        // see who has the min. A full set of 8 children can be compared all
+        // at once with AVX2.
+        int children = rightIndex - leftIndex + 1;
+        if (Arity == 8 && children == 8)
+            minIndex = leftIndex + minOfEightKeys(&keys[leftIndex]);
         else
-            minIndex = leftIndex;
-    } else {
+            minIndex = leftIndex + minKeyScalar(&keys[leftIndex], children);
 
-        //Compare to see who has the min the left or the right
-        if (Patients[leftIndex] < Patients[rightIndex])
-            minIndex = leftIndex;
-        else
-            minIndex = rightIndex;
-    }
+        //Stop once the smallest child comes after the moving entry
+        if (movingKey <= keys[minIndex])
+            break;
 
-    //Swap if the child index is less than the parent
-    if (Patients[index] > Patients[minIndex]) {
-        Patient temp = Patients[minIndex];
-        Patients[minIndex] = Patients[index];
-        Patients[index] = temp;
-        siftDown(minIndex);
+        //The child moves up into the hole instead of being swapped
+        setEntry(index, keys[minIndex], slots[minIndex]);
+        index = minIndex;
+        leftIndex = getLeftChild(index);
     }
+
+    //Write the entry once into where the hole ended up
+    setEntry(index, movingKey, movingSlot);
 }
 
-int PatientPriorityQueue::getLeftChild(int index) const {
-    return 2 * index + 1;
+template <int Arity, class Allocator, template <class, class> class Storage>
+int BasicPatientPriorityQueue<Arity, Allocator, Storage>::getLeftChild(
+        int index) const {
+    return Arity * index + 1;
 }
 
-int PatientPriorityQueue::getRightChild(int index) const {
-    return 2 * index + 2;
+template <int Arity, class Allocator, template <class, class> class Storage>
+int BasicPatientPriorityQueue<Arity, Allocator, Storage>::getRightChild(
+        int index) const {
+    return Arity * index + Arity;
 }
 
 
 
-const Patient PatientPriorityQueue::remove() {
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::setEntry(
+        int index, uint64_t key, int slot) {
+    keys[index] = key;
+    slots[index] = slot;
+    positions[slot] = index;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+typename BasicPatientPriorityQueue<Arity, Allocator, Storage>::PatientType
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::remove() {
     //Assert if it is empty
     assert(!empty());
 
-    //Set temp to Patient
-    Patient temp = Patients[0];
+    //The root is the highest priority Patient
+    PatientType temp = Patients[slots[0]].toPatient(CharAllocator(allocator));
+    removeAt(0);
+    return temp;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::pop() {
+    //Assert if it is empty
+    assert(!empty());
+
+    //Same as remove without copying the name
+    removeAt(0);
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+optional<typename BasicPatientPriorityQueue<Arity, Allocator,
+                                            Storage>::PatientType>
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::cancel(
+        PatientHandle handle) {
 
-    //Swap the root with the last one
-    Patients[0] = Patients[nextPatientNumber - 1];
+    //The Patient of a stale handle has already left
+    if (!contains(handle))
+        return nullopt;
 
-    //Delete the root that was just swapped
-    Patients.pop_back();
+    //The slot of the handle knows where its entry is in the heap
+    optional<PatientType> temp(
+            Patients[handle.slot].toPatient(CharAllocator(allocator)));
+    removeAt(positions[handle.slot]);
+    return temp;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::removeAt(int index) {
 
-    //Sift down
-    if (Patients.size() > 1)
-        siftDown(0);
+    //Release a spilled name from the arena and give the slot back to the
+    // pool for the next Patient to be added
+    int slot = slots[index];
+    if (Patients[slot].hasSpilledName())
+        names->release(Patients[slot].getNameRef());
+    Patients.release(slot);
+    positions[slot] = -1;
+
+    //Move the last entry into the hole
+    int last = nextPatientNumber - 1;
+    if (index != last)
+        setEntry(index, keys[last], slots[last]);
+
+    //Delete the last entry that was just moved
+    keys.pop_back();
+    slots.pop_back();
 
     //Decrement
     nextPatientNumber--;
 
-    //Return the old Patient object
-    return temp;
+    //The last entry might belong above or below the hole
+    if (index < nextPatientNumber) {
+        if (index > 0 && keys[getParent(index)] > keys[index])
+            siftUp(index);
+        else
+            siftDown(index);
+    }
+    shrinkIfDrained();
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+int BasicPatientPriorityQueue<Arity, Allocator, Storage>::removeN(
+        int count, vector<PatientType> &buffer) {
+    count = min(count, nextPatientNumber);
+    if (count <= 0)
+        return 0;
+    buffer.reserve(buffer.size() + count);
+
+    //Popping the root again and again is cheaper until the batch is most of
+    // the queue, or half of a queue too large for the cache to hold its keys
+    bool select = 4 * count >= 3 * nextPatientNumber ||
+                  (2 * count >= nextPatientNumber &&
+                   nextPatientNumber >= SELECT_MIN_PATIENTS);
+    if (!select) {
+        for (int i = 0; i < count; i++) {
+            buffer.push_back(Patients[slots[0]].toPatient(
+                    CharAllocator(allocator)));
+            removeAt(0);
+        }
+        return count;
+    }
+
+    //Copy the keys out with their heap index and move the smallest ones to
+    // the front in linear time, so only the batch itself has to be sorted
+    auto earlier = [](const Candidate &left, const Candidate &right) {
+        return left.key < right.key;
+    };
+    candidates.clear();
+    for (int i = 0; i < nextPatientNumber; i++)
+        candidates.push_back({keys[i], i});
+    nth_element(candidates.begin(), candidates.begin() + (count - 1),
+                candidates.end(), earlier);
+    sort(candidates.begin(), candidates.begin() + count, earlier);
+
+    //The whole batch is known up front, so unlike popping one root at a
+    // time the slots and the records can be fetched ahead of use
+    const int AHEAD = 8;
+    for (int i = 0; i < count; i++) {
+        if (i + 2 * AHEAD < count)
+            P3_PREFETCH(&slots[candidates[i + 2 * AHEAD].index]);
+        if (i + AHEAD < count)
+            P3_PREFETCH(&Patients[slots[candidates[i + AHEAD].index]]);
+        int index = candidates[i].index;
+        int slot = slots[index];
+        buffer.push_back(Patients[slot].toPatient(CharAllocator(allocator)));
+
+        //Give the name and the slot back
+        if (Patients[slot].hasSpilledName())
+            names->release(Patients[slot].getNameRef());
+        Patients.release(slot);
+        positions[slot] = -1;
+
+        //No Patient has a key this large, so it marks the entry as picked
+        keys[index] = PICKED_KEY;
+    }
+
+    //Keep the entries that are left in place and rebuild the heap in linear
+    // time, which is cheaper than sifting a large batch out one at a time
+    int kept = 0;
+    for (int i = 0; i < nextPatientNumber; i++) {
+        if (keys[i] != PICKED_KEY)
+            setEntry(kept++, keys[i], slots[i]);
+    }
+    keys.resize(kept);
+    slots.resize(kept);
+    nextPatientNumber = kept;
+    heapify();
+    shrinkIfDrained();
+    return count;
 }
 
-const Patient PatientPriorityQueue::peek() const {
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::shrinkIfDrained() {
+
+    //Give back the memory of a surge once the queue has drained far enough
+    int floor = max(minimumCapacity, reservedCapacity);
+    if (peakSize > floor && nextPatientNumber < shrinkThreshold * peakSize) {
+        shrink(max(2 * nextPatientNumber, floor));
+        peakSize = nextPatientNumber;
+    }
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+bool BasicPatientPriorityQueue<Arity, Allocator, Storage>::changePriority(
+        PatientHandle handle, int priorityCode) {
+    assert(isPriorityCode(priorityCode));
+    if (!contains(handle))
+        return false;
+
+    //Keep the arrival order from the low bits of the old key
+    int index = positions[handle.slot];
+    uint64_t oldKey = keys[index];
+    int arrivalOrder = (int) (oldKey & (((uint64_t) 1 << 56) - 1));
+    keys[index] = Patient::makeOrderKey(priorityCode, arrivalOrder);
+    Patients[handle.slot].setPriorityCode(priorityCode);
+
+    //A more urgent code moves the Patient up, a less urgent one down
+    if (keys[index] < oldKey)
+        siftUp(index);
+    else
+        siftDown(index);
+    return true;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+PoolStats
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::recordPoolStats() const {
+    return Patients.getStats();
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+bool BasicPatientPriorityQueue<Arity, Allocator, Storage>::contains(
+        PatientHandle handle) const {
+
+    //A slot that was never handed out or was already removed has no index,
+    // and a slot handed out again holds a Patient of a later arrival order
+    return handle.slot >= 0 && handle.slot < (int) positions.size() &&
+           positions[handle.slot] != -1 &&
+           (uint32_t) Patients[handle.slot].getArrivalOrder() ==
+           handle.generation;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+const PatientRecord &
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::peek() const {
 
     //The top of the priority queue
     assert(!empty());
-    return Patients[0];
+    return Patients[slots[0]];
 }
 
-bool PatientPriorityQueue::empty() const {
+template <int Arity, class Allocator, template <class, class> class Storage>
+template <class Visitor>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::forEach(
+        Visitor visitor) const {
+
+    //Visit the records in the order of the heap
+    for (int i = 0; i < nextPatientNumber; i++)
+        visitor(Patients[slots[i]]);
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+typename BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::begin() const {
+    return const_iterator(this, 0);
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+typename BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::end() const {
+    return const_iterator(this, nextPatientNumber);
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+const_iterator(const BasicPatientPriorityQueue *queue, int index) {
+    this->queue = queue;
+    this->index = index;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+const PatientRecord &
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+operator*() const {
+
+    //The heap index leads to the slot, which leads to the record
+    return queue->Patients[queue->slots[index]];
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+const PatientRecord *
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+operator->() const {
+    return &**this;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+typename BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator &
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+operator++() {
+    index++;
+    return *this;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+typename BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator
+BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+operator++(int) {
+    const_iterator old = *this;
+    index++;
+    return old;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+bool BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+operator==(const const_iterator &other) const {
+    return index == other.index;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+bool BasicPatientPriorityQueue<Arity, Allocator, Storage>::const_iterator::
+operator!=(const const_iterator &other) const {
+    return index != other.index;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+bool BasicPatientPriorityQueue<Arity, Allocator, Storage>::empty() const {
 
     //Check if there are still Patients in the queue
     return nextPatientNumber == 0;
 }
 
-string PatientPriorityQueue::to_string() const {
+template <int Arity, class Allocator, template <class, class> class Storage>
+void BasicPatientPriorityQueue<Arity, Allocator, Storage>::appendTo(
+        string &buffer) const {
 
-    //Print out the list in level order
-    stringstream ss;
+    //Make room for every row up front, assuming short names
+    size_t rowWidth = Patient::ROW_WIDTH + 16;
+    buffer.reserve(buffer.size() + nextPatientNumber * rowWidth);
+
+    //Heap order jumps around the record slabs, so fetch the records a few
+    // rows ahead while the current row is formatted
+    const int AHEAD = 8;
     for (int i = 0; i < nextPatientNumber; i++) {
-        ss << Patients[i].to_string();
+        if (i + AHEAD < nextPatientNumber)
+            P3_PREFETCH(&Patients[slots[i + AHEAD]]);
+        Patients[slots[i]].appendTo(buffer);
     }
-    return ss.str();
 }
 
-int PatientPriorityQueue::size() {
+template <int Arity, class Allocator, template <class, class> class Storage>
+string BasicPatientPriorityQueue<Arity, Allocator, Storage>::to_string() const {
+
+    //Print out the list in level order
+    string list;
+    appendTo(list);
+    return list;
+}
+
+template <int Arity, class Allocator, template <class, class> class Storage>
+int BasicPatientPriorityQueue<Arity, Allocator, Storage>::size() {
 
     //returns the size of the vector
     return nextPatientNumber;
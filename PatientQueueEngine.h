@@ -0,0 +1,84 @@
+// Name: Phubeth Mettaprasert
+// File: PatientQueueEngine.h
+// Date: May 27, 2022
+//The requirements every queue engine of the triage system has to meet. An
+// engine is any class that stores Patient objects and hands them back in the
+// order of Patient::operator<, so code that is written as a template over
+// the engine can run on any of them:
+//   BasicPatientPriorityQueue<Arity>  vector d-ary heap (PatientPriorityQueue)
+//   BucketPatientQueue                one FIFO ring per priority code
+//   PairingPatientQueue               pairing heap of linked nodes
+//   RadixPatientQueue                 radix heap over the packed order keys
+//Purpose: Lets the engine be picked by a template parameter, so the fastest
+//         engine for a workload can be chosen by measuring them all on the
+//         same trace.
+//
+//An engine must provide:
+//   Engine()                    creates an empty queue
+//   add(string, int)            adds a patient by name and priority code,
+//                               any return value is ignored
+//   Patient remove()            removes and returns the next patient
+//   peek() const                returns a const reference to the next
+//                               patient without removing or copying it,
+//                               with getNameView, getPriorityCode and
+//                               getArrivalOrder like Patient
+//   int size()                  the number of patients waiting
+//   string to_string() const    every waiting patient, one per line
+
+#ifndef P3_PATIENTQUEUEENGINE_H
+#define P3_PATIENTQUEUEENGINE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "Patient.h"
+
+using namespace std;
+
+template <class Engine>
+void requirePatientQueueEngine();
+// Fails to compile with a message naming the missing part if the class does
+// not meet the requirements of an engine. Call it from templates that take
+// an engine as a parameter.
+// preconditions: none
+// postconditions: none
+
+template <class Engine>
+void requirePatientQueueEngine() {
+    static_assert(is_default_constructible<Engine>::value,
+                  "An engine needs a default constructor");
+    static_assert(sizeof(decltype(declval<Engine &>().add(declval<string>(),
+                                                          0)) *) > 0,
+                  "An engine needs add(string, int)");
+    static_assert(is_same<decltype(declval<Engine &>().remove()),
+                          Patient>::value,
+                  "An engine needs Patient remove()");
+    static_assert(is_lvalue_reference<
+                          decltype(declval<const Engine &>().peek())>::value,
+                  "An engine needs a const peek() that returns a reference");
+    static_assert(is_convertible<
+                          decltype(declval<const Engine &>().peek()
+                                           .getNameView()),
+                          string_view>::value,
+                  "The patient peek() returns needs getNameView()");
+    static_assert(is_convertible<
+                          decltype(declval<const Engine &>().peek()
+                                           .getPriorityCode()),
+                          int>::value,
+                  "The patient peek() returns needs getPriorityCode()");
+    static_assert(is_convertible<
+                          decltype(declval<const Engine &>().peek()
+                                           .getArrivalOrder()),
+                          uint64_t>::value,
+                  "The patient peek() returns needs getArrivalOrder()");
+    static_assert(is_convertible<decltype(declval<Engine &>().size()),
+                                 int>::value,
+                  "An engine needs int size()");
+    static_assert(is_same<decltype(declval<const Engine &>().to_string()),
+                          string>::value,
+                  "An engine needs a const string to_string()");
+}
+
+#endif //P3_PATIENTQUEUEENGINE_H
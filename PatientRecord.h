@@ -0,0 +1,246 @@
+// Name: Phubeth Mettaprasert
+// File: PatientRecord.h
+// Date: May 27, 2022
+//The header file and the implementation of the PatientRecord class. The way
+// a PatientPriorityQueue stores a waiting patient: a record of exactly one
+// cache line with the arrival order, the priority code and the name. Names
+// of up to INLINE_NAME_CAPACITY characters are kept inside the record, and
+// longer names spill to the NameArena of the queue, in which case the
+// record keeps the arena and the offset and length of the name instead.
+//Purpose: Lets the queue keep most names without touching a second buffer.
+//         The record is trivially copyable, so it is copied with a plain
+//         memcpy, and is aligned to a cache line so a record never straddles
+//         two. A record has the same getters as a Patient so it can be
+//         displayed the same way, and can be turned into a Patient that owns
+//         its name when the patient leaves the queue.
+
+#ifndef P3_PATIENTRECORD_H
+#define P3_PATIENTRECORD_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "NameArena.h"
+#include "Patient.h"
+
+using namespace std;
+
+class alignas(64) PatientRecord {
+public:
+    //The longest name that is kept inside the record
+    static const size_t INLINE_NAME_CAPACITY = 54;
+
+    PatientRecord();
+    // Default constructor that creates an empty record. Used to fill the
+    // unused slots of containers that are sized ahead of time.
+    // preconditions: none
+    // postconditions: Creates a record with an empty inline name.
+
+    PatientRecord(string_view, int, uint64_t, NameArena &);
+    // Constructor that initializes the PatientRecord class.
+    // preconditions: none
+    // postconditions: Takes in the name, the priority code and the arrival
+    //                 order. A name longer than INLINE_NAME_CAPACITY is
+    //                 added to the arena.
+
+    string getPatientName() const;
+    // Returns a copy of the name of the patient.
+    // preconditions: A spilled name has not been released from the arena.
+    // postconditions: none
+
+    string_view getNameView() const;
+    // Returns the name of the patient without copying it. The view is valid
+    // until the record or the arena of a spilled name is changed.
+    // preconditions: A spilled name has not been released from the arena.
+    // postconditions: none
+
+    int getPriorityCode() const;
+    // Returns the priority code of the patient.
+    // preconditions: none
+    // postconditions: none
+
+    uint64_t getArrivalOrder() const;
+    // Returns the arrival order of the patient, starting at zero.
+    // preconditions: none
+    // postconditions: none
+
+    string getPriorityInString() const;
+    // Returns the string of the priority code.
+    // preconditions: none
+    // postconditions: none
+
+    string to_string() const;
+    // Returns the same string as Patient::to_string for this patient.
+    // preconditions: A spilled name has not been released from the arena.
+    // postconditions: none
+
+    void appendTo(string &) const;
+    // Appends the same row as Patient::appendTo for this patient to the end
+    // of the buffer.
+    // preconditions: A spilled name has not been released from the arena.
+    // postconditions: The row is at the end of the buffer.
+
+    Patient toPatient() const;
+    // Returns a Patient that owns a copy of the name, for when the patient
+    // leaves the queue.
+    // preconditions: A spilled name has not been released from the arena.
+    // postconditions: none
+
+    template <class CharAllocator>
+    BasicPatient<CharAllocator> toPatient(const CharAllocator &) const;
+    // Returns a Patient with a copy of the name allocated through the
+    // allocator, such as the pmr allocator of the queue.
+    // preconditions: A spilled name has not been released from the arena.
+    // postconditions: none
+
+    bool hasSpilledName() const;
+    // Returns true if the name was too long for the record and is kept in
+    // the arena.
+    // preconditions: none
+    // postconditions: none
+
+    NameArena::Ref getNameRef() const;
+    // Returns where a spilled name is in the arena, so it can be released
+    // or moved when the arena is compacted.
+    // preconditions: The name is spilled.
+    // postconditions: none
+
+    void setNameRef(NameArena::Ref);
+    // A setter method used when the arena moves a spilled name.
+    // preconditions: The name is spilled.
+    // postconditions: The record will refer to the new place of the name.
+
+    void setPriorityCode(int);
+    // A setter method used when a patient is re-triaged.
+    // preconditions: none
+    // postconditions: The record will have the new priority code.
+
+private:
+
+    //Kept in the name bytes instead of an inline name when it spills
+    struct SpilledName {
+        const NameArena *names; //The arena that holds the name
+        NameArena::Ref ref; //Where the name is in the arena
+    };
+
+    static const uint8_t SPILLED = 0xFF; //The name length of a spilled name
+
+    SpilledName getSpilledName() const;
+    // A method that assists the getters. Reads the arena and reference of a
+    // spilled name out of the name bytes.
+    // preconditions: The name is spilled.
+    // postconditions: none
+
+    uint64_t arrivalOrder; //Store the arrival order of the patient
+    uint8_t priorityCode; //Store the priority code of the patient
+    uint8_t nameLength; //Length of the inline name, or SPILLED
+    char name[INLINE_NAME_CAPACITY]; //The inline name or a SpilledName
+};
+
+static_assert(sizeof(PatientRecord) == 64,
+              "A PatientRecord fills exactly one cache line");
+static_assert(is_trivially_copyable<PatientRecord>::value,
+              "A PatientRecord is copied with memcpy");
+
+PatientRecord::PatientRecord() {
+
+    //An empty record that is never called by the priority queue.
+    arrivalOrder = 0;
+    priorityCode = 0;
+    nameLength = 0;
+}
+
+PatientRecord::PatientRecord(string_view name, int priorityCode,
+                             uint64_t arrivalOrder, NameArena &names) {
+
+    //Constructor that sets the private attributes by the arguments put in.
+    this->arrivalOrder = arrivalOrder;
+    this->priorityCode = (uint8_t) priorityCode;
+
+    //Short names are copied into the record, longer ones into the arena
+    if (name.size() <= INLINE_NAME_CAPACITY) {
+        nameLength = (uint8_t) name.size();
+        memcpy(this->name, name.data(), name.size());
+    } else {
+        SpilledName spilled = {&names, names.add(name)};
+        nameLength = SPILLED;
+        memcpy(this->name, &spilled, sizeof(spilled));
+    }
+}
+
+string PatientRecord::getPatientName() const {
+    return string(getNameView());
+}
+
+string_view PatientRecord::getNameView() const {
+    if (!hasSpilledName())
+        return string_view(name, nameLength);
+    SpilledName spilled = getSpilledName();
+    return spilled.names->view(spilled.ref);
+}
+
+int PatientRecord::getPriorityCode() const {
+    return priorityCode;
+}
+
+uint64_t PatientRecord::getArrivalOrder() const {
+    return arrivalOrder;
+}
+
+string PatientRecord::getPriorityInString() const {
+    return Patient::getPriorityInString(priorityCode);
+}
+
+string PatientRecord::to_string() const {
+    return Patient::to_string(getNameView(), priorityCode,
+                              (int) arrivalOrder);
+}
+
+void PatientRecord::appendTo(string &buffer) const {
+    Patient::appendTo(buffer, getNameView(), priorityCode,
+                      (int) arrivalOrder);
+}
+
+Patient PatientRecord::toPatient() const {
+    return Patient(getPatientName(), priorityCode, (int) arrivalOrder);
+}
+
+template <class CharAllocator>
+BasicPatient<CharAllocator> PatientRecord::toPatient(
+        const CharAllocator &allocator) const {
+    return BasicPatient<CharAllocator>(getNameView(), priorityCode,
+                                       (int) arrivalOrder, allocator);
+}
+
+bool PatientRecord::hasSpilledName() const {
+    return nameLength == SPILLED;
+}
+
+NameArena::Ref PatientRecord::getNameRef() const {
+    return getSpilledName().ref;
+}
+
+void PatientRecord::setNameRef(NameArena::Ref ref) {
+    SpilledName spilled = getSpilledName();
+    spilled.ref = ref;
+    memcpy(name, &spilled, sizeof(spilled));
+}
+
+void PatientRecord::setPriorityCode(int priorityCode) {
+
+    //Only the priority changes, the patient keeps their place in line
+    this->priorityCode = (uint8_t) priorityCode;
+}
+
+PatientRecord::SpilledName PatientRecord::getSpilledName() const {
+    assert(hasSpilledName());
+
+    //The name bytes are not aligned for a pointer, so copy them out
+    SpilledName spilled;
+    memcpy(&spilled, name, sizeof(spilled));
+    return spilled;
+}
+
+#endif //P3_PATIENTRECORD_H
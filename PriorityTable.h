@@ -0,0 +1,104 @@
+// Name: Phubeth Mettaprasert
+// File: PriorityTable.h
+// Date: May 27, 2022
+//The table of the triage priority codes: the name of each code, the code
+// itself and how many minutes a patient with the code should wait at most.
+//Purpose: The one place the priority codes are written down. The table and
+//         the lookups are constexpr, so looking up the name of a code is
+//         indexing the table, and the number of codes is known at compile
+//         time so queue engines that keep one bucket per code can size their
+//         arrays with it.
+
+#ifndef P3_PRIORITYTABLE_H
+#define P3_PRIORITYTABLE_H
+
+#include <string_view>
+
+using namespace std;
+
+struct PriorityLevel {
+    string_view name; //What the code is called on the command line
+    int code; //The priority code, where 1 is seen first
+    int slaMinutes; //The longest a patient with the code should wait
+};
+
+//Every priority code in order, so the code of an entry is its index plus 1
+constexpr PriorityLevel PRIORITY_TABLE[] = {
+        {"immediate", 1, 0},
+        {"emergency", 2, 15},
+        {"urgent", 3, 30},
+        {"minimal", 4, 120}};
+
+//The number of priority codes
+constexpr int PRIORITY_LEVEL_COUNT =
+        sizeof(PRIORITY_TABLE) / sizeof(PRIORITY_TABLE[0]);
+
+constexpr bool isPriorityCode(int);
+// Returns true if the code is in the priority table.
+// preconditions: none
+// postconditions: none
+
+constexpr string_view getPriorityName(int);
+// Returns the name of the code, or an empty view if the code is not in the
+// priority table.
+// preconditions: none
+// postconditions: none
+
+constexpr int getSlaMinutes(int);
+// Returns the longest a patient with the code should wait in minutes, or -1
+// if the code is not in the priority table.
+// preconditions: none
+// postconditions: none
+
+constexpr int findPriorityCode(string_view);
+// Returns the code with the name, or -1 if no code has the name.
+// preconditions: none
+// postconditions: none
+
+constexpr bool priorityCodesInOrder();
+// Returns true if the code of every entry of the table is its index plus 1,
+// which the lookups by code rely on. Checked at compile time.
+// preconditions: none
+// postconditions: none
+
+constexpr bool isPriorityCode(int code) {
+    return code >= 1 && code <= PRIORITY_LEVEL_COUNT;
+}
+
+constexpr string_view getPriorityName(int code) {
+    return isPriorityCode(code) ? PRIORITY_TABLE[code - 1].name
+                                : string_view();
+}
+
+constexpr int getSlaMinutes(int code) {
+    return isPriorityCode(code) ? PRIORITY_TABLE[code - 1].slaMinutes : -1;
+}
+
+constexpr int findPriorityCode(string_view name) {
+
+    //There are only a few codes, so compare the names one by one
+    for (const PriorityLevel &level : PRIORITY_TABLE) {
+        if (level.name == name)
+            return level.code;
+    }
+    return -1;
+}
+
+constexpr bool priorityCodesInOrder() {
+    for (int i = 0; i < PRIORITY_LEVEL_COUNT; i++) {
+        if (PRIORITY_TABLE[i].code != i + 1)
+            return false;
+    }
+    return true;
+}
+
+static_assert(priorityCodesInOrder(),
+              "The code of each priority level is its index plus 1");
+static_assert(PRIORITY_LEVEL_COUNT < 128,
+              "A priority code has to fit in the top byte of an order key "
+              "and leave the key below 2^63 for the signed AVX2 compare");
+static_assert(findPriorityCode("urgent") == 3 &&
+              getPriorityName(2) == "emergency",
+              "The lookups run at compile time");
+
+#endif //P3_PRIORITYTABLE_H
@@ -0,0 +1,262 @@
+// Name: Phubeth Mettaprasert
+// File: RadixPatientQueue.h
+// Date: May 27, 2022
+//The header file and the implementation of the RadixPatientQueue. An engine
+// for the triage system (see PatientQueueEngine.h) that stores the Patient
+// objects in a radix heap over their packed order keys.
+//Purpose: A radix heap keeps the last removed key and puts each Patient in
+//         the bucket of the highest bit where its key differs from that last
+//         key. Removing a Patient only sorts the first non empty bucket into
+//         the lower buckets, so every Patient is moved at most once per bit
+//         of the key instead of being sifted on every operation.
+//
+//A radix heap is monotone: it expects every new key to be at least the last
+//removed key. Arrival order only increases, but a Patient can arrive with a
+//more urgent code than the Patient that was just removed. Those Patients are
+//kept in a small binary heap next to the buckets instead. Their keys are
+//smaller than every key in the buckets, so they are always removed first,
+//and the buckets never have to be sorted again for a smaller last key.
+
+#ifndef P3_RADIXPATIENTQUEUE_H
+#define P3_RADIXPATIENTQUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cassert>
+#include "Patient.h"
+
+using namespace std;
+
+class RadixPatientQueue {
+public:
+    RadixPatientQueue();
+    // Constructor that initializes the RadixPatientQueue class.
+    // preconditions: none
+    // postconditions: Sets the arrivalOrder and the last key to zero.
+
+    void add(string, int);
+    // A method to add a Patient object to the bucket for its order key.
+    // preconditions: none
+    // postconditions: A Patient object will be added to the heap.
+
+    Patient remove();
+    // A method to remove the Patient object with the smallest order key.
+    // preconditions: The heap must not be empty.
+    // postconditions: The Patient will be removed from the heap and moved
+    //                 out to the caller. Its key becomes the last key.
+
+    const Patient &peek() const;
+    // Returns the highest priority patient without removing or copying the
+    // patient. The reference is valid until the queue is changed.
+    // preconditions: The heap must not be empty.
+    // postconditions: none
+
+    int size();
+    // Returns the number of patients still waiting.
+    // preconditions: none
+    // postconditions: none
+
+    string to_string() const;
+    // Returns the string represation of the object, the early heap first and
+    // then bucket by bucket. Only the first patient listed is sure to be the
+    // next one seen.
+    // preconditions: none. The heap can be empty.
+    // postconditions: none
+
+private:
+
+    static const int BUCKETS = 65; //One for the last key and one per key bit
+
+    struct Entry {
+        uint64_t key; //The order key of the Patient
+        Patient patient; //The Patient stored in the entry
+    };
+
+    int arrivalOrderNo; //A private variable to keep track of the arrival order
+    int nextPatientNumber; //The number of Patients in all the buckets
+    uint64_t lastKey; //The key the buckets are relative to
+    vector<Entry> buckets[BUCKETS]; //Bucket i holds keys differing at bit i-1
+    vector<Entry> early; //Heap of the keys smaller than the last key
+
+    static bool laterKey(const Entry &, const Entry &);
+    // Returns true if the first entry comes after the second one. Used as
+    // the comparison that makes the early vector a min heap.
+    // preconditions: none
+    // postconditions: none
+
+    int getBucket(uint64_t) const;
+    // Returns the bucket for the key: zero if it equals the last key, or one
+    // more than the highest bit where it differs from the last key.
+    // preconditions: The key is not smaller than the last key.
+    // postconditions: none
+
+    void redistribute(int);
+    // A method that assists the add and remove methods. Moves every entry of
+    // a bucket into the bucket it belongs to for the current last key.
+    // preconditions: none
+    // postconditions: The bucket will be empty unless its entries still
+    //                 belong in it.
+
+    int firstNonEmpty() const;
+    // Returns the index of the first bucket that is not empty.
+    // preconditions: The heap must not be empty.
+    // postconditions: none
+
+    int minEntry(int) const;
+    // Returns the index of the entry with the smallest key in the bucket.
+    // preconditions: The bucket must not be empty.
+    // postconditions: none
+
+    bool empty() const;
+    // A method to check if the heap is empty. Returns true if it is.
+    // preconditions: none
+    // postconditions: none
+};
+
+RadixPatientQueue::RadixPatientQueue() {
+
+    //Starts the arrival order number, patient number and last key at zero.
+    arrivalOrderNo = 0;
+    nextPatientNumber = 0;
+    lastKey = 0;
+}
+
+void RadixPatientQueue::add(string name, int priorityCode) {
+    uint64_t key = Patient::makeOrderKey(priorityCode, arrivalOrderNo);
+
+    //A more urgent key than the last removed one would break the monotone
+    // order of the buckets, so it goes into the early heap instead
+    Entry entry = {key, Patient(std::move(name), priorityCode,
+                                arrivalOrderNo)};
+    if (key < lastKey) {
+        early.push_back(std::move(entry));
+        push_heap(early.begin(), early.end(), laterKey);
+    } else {
+        buckets[getBucket(key)].push_back(std::move(entry));
+    }
+
+    //Increment the arrival order and the patient number
+    arrivalOrderNo++;
+    nextPatientNumber++;
+}
+
+int RadixPatientQueue::getBucket(uint64_t key) const {
+    uint64_t difference = key ^ lastKey;
+    if (difference == 0)
+        return 0;
+
+    //One more than the index of the highest bit that differs
+#if defined(__GNUC__) || defined(__clang__)
+    return 64 - __builtin_clzll(difference);
+#else
+    int bucket = 0;
+    while (difference != 0) {
+        difference >>= 1;
+        bucket++;
+    }
+    return bucket;
+#endif
+}
+
+void RadixPatientQueue::redistribute(int bucket) {
+
+    //Take the entries out first, since some might go back into this bucket
+    vector<Entry> entries;
+    entries.swap(buckets[bucket]);
+    for (Entry &entry : entries)
+        buckets[getBucket(entry.key)].push_back(std::move(entry));
+}
+
+int RadixPatientQueue::firstNonEmpty() const {
+    int bucket = 0;
+    while (buckets[bucket].empty())
+        bucket++;
+    return bucket;
+}
+
+int RadixPatientQueue::minEntry(int bucket) const {
+    int minIndex = 0;
+    for (int i = 1; i < (int) buckets[bucket].size(); i++) {
+        if (buckets[bucket][i].key < buckets[bucket][minIndex].key)
+            minIndex = i;
+    }
+    return minIndex;
+}
+
+bool RadixPatientQueue::laterKey(const Entry &first, const Entry &second) {
+    return first.key > second.key;
+}
+
+Patient RadixPatientQueue::remove() {
+    //Assert if it is empty
+    assert(!empty());
+
+    //The early keys are smaller than any key in the buckets
+    if (!early.empty()) {
+        pop_heap(early.begin(), early.end(), laterKey);
+        Patient temp = std::move(early.back().patient);
+        early.pop_back();
+        nextPatientNumber--;
+        return temp;
+    }
+
+    //Bucket zero only ever holds the last key. If it is empty, the smallest
+    // key of the first non empty bucket becomes the last key, and that
+    // bucket is split up into the lower buckets.
+    if (buckets[0].empty()) {
+        int bucket = firstNonEmpty();
+        lastKey = buckets[bucket][minEntry(bucket)].key;
+        redistribute(bucket);
+    }
+
+    //Keys are never equal, so bucket zero holds exactly one entry
+    Patient temp = std::move(buckets[0].back().patient);
+    buckets[0].pop_back();
+
+    //Decrement
+    nextPatientNumber--;
+
+    //Return the old Patient object
+    return temp;
+}
+
+const Patient &RadixPatientQueue::peek() const {
+
+    //The smallest early key, or the smallest key of the first non empty
+    // bucket
+    assert(!empty());
+    if (!early.empty())
+        return early.front().patient;
+    int bucket = firstNonEmpty();
+    return buckets[bucket][minEntry(bucket)].patient;
+}
+
+bool RadixPatientQueue::empty() const {
+
+    //Check if there are still Patients in any bucket
+    return nextPatientNumber == 0;
+}
+
+string RadixPatientQueue::to_string() const {
+
+    //Print out the early heap and then every bucket from the one for the
+    // last key upwards
+    string list;
+    for (const Entry &entry : early)
+        entry.patient.appendTo(list);
+    for (int bucket = 0; bucket < BUCKETS; bucket++) {
+        for (const Entry &entry : buckets[bucket])
+            entry.patient.appendTo(list);
+    }
+    return list;
+}
+
+int RadixPatientQueue::size() {
+
+    //returns the number of patients in all the buckets
+    return nextPatientNumber;
+}
+
+#endif //P3_RADIXPATIENTQUEUE_H
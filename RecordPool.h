@@ -0,0 +1,325 @@
+// Name: Phubeth Mettaprasert
+// File: RecordPool.h
+// Date: May 27, 2022
+//The header file and the implementation of the RecordPool class. A pool of
+// records that are handed out by slot number and recycled through a free
+// list, such as the PatientRecords of a PatientPriorityQueue.
+//Purpose: Records are allocated in slabs of a fixed size through the
+//         allocator given as a template parameter. Growing the pool adds a
+//         slab instead of moving every record like a vector would, so the
+//         slot of a record never moves. Released slots go on a free list and
+//         are handed out again first, so once the pool has grown to the
+//         largest number of records in use, acquiring and releasing records
+//         does not allocate any memory. After a surge, trim gives back every
+//         slab whose slots are all released. The slot numbers of a slab that
+//         was given back stay reserved, and the slab is allocated again
+//         before the pool grows past its last slab.
+
+#ifndef P3_RECORDPOOL_H
+#define P3_RECORDPOOL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+struct PoolStats {
+    size_t slabs; //The number of slabs allocated
+    size_t capacity; //The number of records in all the slabs
+    size_t inUse; //The number of records handed out and not released
+    size_t acquired; //The number of times a record was handed out
+    size_t recycled; //How many of those reused a released record
+};
+
+template <class T, class Allocator = allocator<T>>
+class RecordPool {
+public:
+    explicit RecordPool(const Allocator & = Allocator());
+    // Constructor that initializes the RecordPool class.
+    // preconditions: none
+    // postconditions: Creates an empty pool that allocates through a copy
+    //                 of the allocator.
+
+    ~RecordPool();
+    // Destructor that destroys every record and frees every slab.
+    // preconditions: none
+    // postconditions: none
+
+    RecordPool(const RecordPool &) = delete;
+    RecordPool &operator=(const RecordPool &) = delete;
+    // The slabs are owned by one pool, so the pool cannot be copied.
+
+    RecordPool(RecordPool &&) = default;
+    // Move constructor that takes over the slabs of the other pool.
+
+    int acquire();
+    // Hands out the slot of a record, reusing a released slot if there is
+    // one and adding a slab if every slot is taken.
+    // preconditions: none
+    // postconditions: Returns the slot. The record keeps whatever value it
+    //                 had when its slot was released, unless its slab was
+    //                 given back by trim.
+
+    void release(int);
+    // Puts the slot on the free list so it can be handed out again.
+    // preconditions: The slot was handed out and not released since.
+    // postconditions: none
+
+    void reserve(int);
+    // Allocates slabs until the pool has room for the number of records.
+    // Trimming never gives back the slabs of the reserved records.
+    // preconditions: none
+    // postconditions: The pool has room for at least that many records.
+
+    void trim();
+    // Gives back every slab past the reserved records whose slots are all
+    // released. Afterwards the lowest released slots are handed out first,
+    // so the slots in use gather in the front slabs for the next trim.
+    // preconditions: none
+    // postconditions: The slots of a freed slab stay off the free list
+    //                 until the slab is allocated again.
+
+    int slotCount() const;
+    // Returns the number of slots handed out at least once since the last
+    // slabs at the end were given back. New slots are numbered from here.
+    // preconditions: none
+    // postconditions: none
+
+    T &operator[](int);
+    // Returns the record of the slot.
+    // preconditions: The slot was handed out and not released since.
+    // postconditions: none
+
+    const T &operator[](int) const;
+    // Returns the record of the slot.
+    // preconditions: The slot was handed out and not released since.
+    // postconditions: none
+
+    PoolStats getStats() const;
+    // Returns how many slabs and records the pool has and how often records
+    // were recycled.
+    // preconditions: none
+    // postconditions: none
+
+    size_t allocatedBytes() const;
+    // Returns the number of bytes the pool has allocated for its slabs and
+    // for keeping track of them.
+    // preconditions: none
+    // postconditions: none
+
+    static constexpr int SLAB_SIZE = 1024; //The number of records in a slab
+
+private:
+    typedef allocator_traits<Allocator> Traits;
+    typedef typename Traits::template rebind_alloc<T *> SlabListAllocator;
+    typedef typename Traits::template rebind_alloc<int> IndexAllocator;
+
+    T *allocateSlab();
+    // A method that assists the acquire and reserve methods. Allocates a
+    // slab and constructs its records.
+    // preconditions: none
+    // postconditions: Returns the first record of the slab.
+
+    void freeSlab(T *);
+    // A method that assists trim and the destructor. Destroys the records of
+    // the slab and frees it.
+    // preconditions: The slab was allocated by allocateSlab.
+    // postconditions: none
+
+    void restoreSlab();
+    // A method that assists the acquire and reserve methods. Allocates the
+    // lowest slab that trim gave back again and puts its slots on the free
+    // list, lowest slot last so it is handed out first.
+    // preconditions: A slab was given back.
+    // postconditions: none
+
+    Allocator allocator; //Allocates the slabs
+    vector<T *, SlabListAllocator> slabs; //Every slab, or null if freed
+    vector<int, IndexAllocator> freeList; //Slots that were released
+    vector<int, IndexAllocator> freedSlabs; //Freed slabs, lowest last
+    int used; //Slots handed out at least once, which are all at the front
+    int reserved; //The number of records trim keeps slabs for
+    size_t liveSlabs; //The number of slabs that are allocated
+    size_t inUse; //The number of slots handed out and not released
+    size_t acquired; //The number of times a slot was handed out
+    size_t recycled; //How many of those came from the free list
+};
+
+template <class T, class Allocator>
+RecordPool<T, Allocator>::RecordPool(const Allocator &allocator)
+        : allocator(allocator), slabs(SlabListAllocator(allocator)),
+          freeList(IndexAllocator(allocator)),
+          freedSlabs(IndexAllocator(allocator)) {
+
+    //Starts with no slabs
+    used = 0;
+    reserved = 0;
+    liveSlabs = 0;
+    inUse = 0;
+    acquired = 0;
+    recycled = 0;
+}
+
+template <class T, class Allocator>
+RecordPool<T, Allocator>::~RecordPool() {
+    for (T *slab : slabs) {
+        if (slab != nullptr)
+            freeSlab(slab);
+    }
+}
+
+template <class T, class Allocator>
+int RecordPool<T, Allocator>::acquire() {
+    acquired++;
+    inUse++;
+
+    //A slab that was given back is allocated again before the pool grows
+    if (freeList.empty() && !freedSlabs.empty())
+        restoreSlab();
+
+    //A released slot is reused first
+    if (!freeList.empty()) {
+        int slot = freeList.back();
+        freeList.pop_back();
+        recycled++;
+        return slot;
+    }
+
+    //Otherwise the next slot that was never handed out, in a new slab if
+    // the last slab is full
+    if (used == (int) slabs.size() * SLAB_SIZE) {
+        slabs.push_back(allocateSlab());
+        liveSlabs++;
+    }
+    return used++;
+}
+
+template <class T, class Allocator>
+T *RecordPool<T, Allocator>::allocateSlab() {
+    T *slab = Traits::allocate(allocator, SLAB_SIZE);
+    for (int i = 0; i < SLAB_SIZE; i++)
+        Traits::construct(allocator, slab + i);
+    return slab;
+}
+
+template <class T, class Allocator>
+void RecordPool<T, Allocator>::freeSlab(T *slab) {
+    for (int i = 0; i < SLAB_SIZE; i++)
+        Traits::destroy(allocator, slab + i);
+    Traits::deallocate(allocator, slab, SLAB_SIZE);
+}
+
+template <class T, class Allocator>
+void RecordPool<T, Allocator>::restoreSlab() {
+    int slab = freedSlabs.back();
+    freedSlabs.pop_back();
+    slabs[slab] = allocateSlab();
+    liveSlabs++;
+
+    //Every slot of a freed slab was handed out before it was freed
+    for (int i = SLAB_SIZE - 1; i >= 0; i--)
+        freeList.push_back(slab * SLAB_SIZE + i);
+}
+
+template <class T, class Allocator>
+void RecordPool<T, Allocator>::release(int slot) {
+    assert(slot >= 0 && slot < used);
+    freeList.push_back(slot);
+    inUse--;
+}
+
+template <class T, class Allocator>
+void RecordPool<T, Allocator>::reserve(int records) {
+    if (records > reserved)
+        reserved = records;
+
+    //Bring back the freed slabs within the reserved records, then grow
+    int needed = (records + SLAB_SIZE - 1) / SLAB_SIZE;
+    while (!freedSlabs.empty() && freedSlabs.back() < needed)
+        restoreSlab();
+    while ((int) slabs.size() < needed) {
+        slabs.push_back(allocateSlab());
+        liveSlabs++;
+    }
+}
+
+template <class T, class Allocator>
+void RecordPool<T, Allocator>::trim() {
+
+    //Count the released slots of every slab
+    vector<int, IndexAllocator> released(slabs.size(), 0,
+                                         freeList.get_allocator());
+    for (int slot : freeList)
+        released[slot / SLAB_SIZE]++;
+
+    //Free the slabs past the reserved records that have nothing in use
+    int keptSlabs = (reserved + SLAB_SIZE - 1) / SLAB_SIZE;
+    for (int slab = keptSlabs; slab < (int) slabs.size(); slab++) {
+        int handedOut = min(SLAB_SIZE, used - slab * SLAB_SIZE);
+        if (slabs[slab] != nullptr && released[slab] == handedOut) {
+            freeSlab(slabs[slab]);
+            slabs[slab] = nullptr;
+            liveSlabs--;
+        }
+    }
+
+    //Freed slabs at the end are forgotten, so their slots are new again
+    while (!slabs.empty() && slabs.back() == nullptr)
+        slabs.pop_back();
+    used = min(used, (int) slabs.size() * SLAB_SIZE);
+
+    //Keep the released slots of the slabs that are left, lowest last
+    vector<int, IndexAllocator> kept(freeList.get_allocator());
+    for (int slot : freeList) {
+        if (slot < used && slabs[slot / SLAB_SIZE] != nullptr)
+            kept.push_back(slot);
+    }
+    sort(kept.begin(), kept.end(), greater<int>());
+    freeList.swap(kept);
+
+    //The freed slabs in the middle are allocated again lowest first
+    freedSlabs.clear();
+    for (int slab = slabs.size() - 1; slab >= 0; slab--) {
+        if (slabs[slab] == nullptr)
+            freedSlabs.push_back(slab);
+    }
+}
+
+template <class T, class Allocator>
+int RecordPool<T, Allocator>::slotCount() const {
+    return used;
+}
+
+template <class T, class Allocator>
+T &RecordPool<T, Allocator>::operator[](int slot) {
+    return slabs[slot / SLAB_SIZE][slot % SLAB_SIZE];
+}
+
+template <class T, class Allocator>
+const T &RecordPool<T, Allocator>::operator[](int slot) const {
+    return slabs[slot / SLAB_SIZE][slot % SLAB_SIZE];
+}
+
+template <class T, class Allocator>
+PoolStats RecordPool<T, Allocator>::getStats() const {
+    PoolStats stats;
+    stats.slabs = liveSlabs;
+    stats.capacity = liveSlabs * SLAB_SIZE;
+    stats.inUse = inUse;
+    stats.acquired = acquired;
+    stats.recycled = recycled;
+    return stats;
+}
+
+template <class T, class Allocator>
+size_t RecordPool<T, Allocator>::allocatedBytes() const {
+    return liveSlabs * SLAB_SIZE * sizeof(T) +
+           slabs.capacity() * sizeof(T *) +
+           (freeList.capacity() + freedSlabs.capacity()) * sizeof(int);
+}
+
+#endif //P3_RECORDPOOL_H
@@ -0,0 +1,173 @@
+// Name: Phubeth Mettaprasert
+// File: ShardedPatientQueue.h
+// Date: May 27, 2022
+//The header file and the implementation of the ShardedPatientQueue. A set
+// of ConcurrentPatientQueues, one for each department such as the emergency
+// room, pediatrics and the fast-track clinic, whose clinicians help out in
+// the other departments when their own has nobody as urgent waiting.
+//Purpose: Every department adds to and removes from its own shard, so the
+//         clinicians of different departments do not wait on one lock. The
+//         shards share one arrival counter, so the order keys of Patients in
+//         different shards compare the same way as Patient::operator<. Each
+//         shard publishes the key of its next Patient, and a clinician reads
+//         those keys without taking any lock to decide where to go: to its
+//         home shard while the head there is as urgent as the head anywhere
+//         else, or else to the shard with the best head, which it steals
+//         from. That way no immediate patient waits in one department while
+//         a clinician in another is idle or seeing a less urgent patient.
+
+#ifndef P3_SHARDEDPATIENTQUEUE_H
+#define P3_SHARDEDPATIENTQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ConcurrentPatientQueue.h"
+
+using namespace std;
+
+class ShardedPatientQueue {
+public:
+    explicit ShardedPatientQueue(int);
+    // Constructor that initializes the ShardedPatientQueue class with the
+    // number of shards.
+    // preconditions: The number is positive.
+    // postconditions: Sets the arrivalOrder to zero and every shard to
+    //                 empty.
+
+    ShardedPatientQueue(const ShardedPatientQueue &) = delete;
+    ShardedPatientQueue &operator=(const ShardedPatientQueue &) = delete;
+    // The shards are shared by threads through a reference, so they cannot
+    // be copied.
+
+    void add(int, string, int);
+    // A method to add a Patient object to a shard with the next arrival
+    // order of the whole queue. Safe to call from any thread.
+    // preconditions: The shard is below shardCount() and the priority code
+    //                is in the priority table.
+    // postconditions: The Patient is in the shard.
+
+    PatientPtr tryRemove(int);
+    // A method for a clinician of the home shard to remove the next
+    // Patient. Takes the head of the home shard unless another shard has a
+    // head with a more urgent priority code, in which case it steals the
+    // head with the smallest order key. Safe to call from any thread.
+    // preconditions: The shard is below shardCount().
+    // postconditions: Returns the Patient, or a null pointer if every shard
+    //                 was empty.
+
+    int size() const;
+    // Returns the number of patients waiting in every shard, which may
+    // already be out of date when it returns.
+    // preconditions: none
+    // postconditions: none
+
+    int shardCount() const;
+    // Returns the number of shards.
+    // preconditions: none
+    // postconditions: none
+
+    ConcurrentPatientQueue &getShard(int);
+    // Returns a shard, such as to list the patients of one department.
+    // preconditions: The shard is below shardCount().
+    // postconditions: none
+
+    long long getSteals() const;
+    // Returns the number of Patients removed from a shard other than the
+    // home shard of the clinician.
+    // preconditions: none
+    // postconditions: none
+
+private:
+
+    int findBestShard(int) const;
+    // A method that assists tryRemove. Reads the head key of every shard
+    // and picks the shard to remove from.
+    // preconditions: none
+    // postconditions: Returns the shard, or -1 if every shard looked empty.
+
+    //The shards are on the heap so each keeps its lock and keys to itself
+    vector<unique_ptr<ConcurrentPatientQueue>> shards;
+    atomic<int> arrivalOrderNo; //Shared by the adds of every shard
+    atomic<long long> steals; //Patients taken from another shard
+};
+
+ShardedPatientQueue::ShardedPatientQueue(int shardCount)
+        : arrivalOrderNo(0), steals(0) {
+    assert(shardCount > 0);
+    for (int i = 0; i < shardCount; i++)
+        shards.push_back(make_unique<ConcurrentPatientQueue>());
+}
+
+void ShardedPatientQueue::add(int shard, string name, int priorityCode) {
+    assert(shard >= 0 && shard < shardCount());
+
+    //The number only has to be unique, since every shard orders its own
+    // Patients by it whatever order the adds get to the shard in
+    int arrivalOrder = arrivalOrderNo.fetch_add(1, memory_order_relaxed);
+    shards[shard]->add(std::move(name), priorityCode, arrivalOrder);
+}
+
+PatientPtr ShardedPatientQueue::tryRemove(int home) {
+    assert(home >= 0 && home < shardCount());
+
+    //The head picked can be taken by another clinician before this one gets
+    // the lock of its shard, so look again until a shard gives a Patient
+    for (;;) {
+        int shard = findBestShard(home);
+        if (shard < 0)
+            return PatientPtr();
+        PatientPtr next = shards[shard]->tryRemove();
+        if (next != nullptr) {
+            if (shard != home)
+                steals.fetch_add(1, memory_order_relaxed);
+            return next;
+        }
+    }
+}
+
+int ShardedPatientQueue::findBestShard(int home) const {
+    uint64_t homeKey = shards[home]->peekKey();
+
+    //The best head of the other shards, by the order of Patient::operator<
+    int best = -1;
+    uint64_t bestKey = ConcurrentPatientQueue::EMPTY_KEY;
+    for (int i = 0; i < shardCount(); i++) {
+        uint64_t key = shards[i]->peekKey();
+        if (i != home && key < bestKey) {
+            best = i;
+            bestKey = key;
+        }
+    }
+
+    //Stay home unless another shard has a more urgent priority code, since
+    // the top byte of a key is the code and an empty shard has the largest
+    if ((homeKey >> 56) <= (bestKey >> 56))
+        return homeKey == ConcurrentPatientQueue::EMPTY_KEY ? -1 : home;
+    return best;
+}
+
+int ShardedPatientQueue::size() const {
+    int waiting = 0;
+    for (const unique_ptr<ConcurrentPatientQueue> &shard : shards)
+        waiting += shard->size();
+    return waiting;
+}
+
+int ShardedPatientQueue::shardCount() const {
+    return (int) shards.size();
+}
+
+ConcurrentPatientQueue &ShardedPatientQueue::getShard(int shard) {
+    assert(shard >= 0 && shard < shardCount());
+    return *shards[shard];
+}
+
+long long ShardedPatientQueue::getSteals() const {
+    return steals.load(memory_order_relaxed);
+}
+
+#endif //P3_SHARDEDPATIENTQUEUE_H
@@ -19,6 +19,8 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -56,17 +58,27 @@ void addPatientCmd(string, PatientPriorityQueue &);
 //         as adding or removing Patient objects in the queue.
 // OUT: Can display error messages if the commands are read incorrectly
 
+bool readAddCmd(string, string &, int &);
+// Reads the priority code and the patient name of an add command.
+// IN: Takes in the string sans command
+// MODIFY: Sets the patient name and the priority code number if the command
+//         is valid.
+// OUT: Returns true if the command is valid. Can display error messages if
+//      the command is read incorrectly
+
 void peekNextCmd(PatientPriorityQueue &);
 // Displays the next patient in the waiting room that will be called.
 // IN: Takes in priority queue
 // MODIFY: none.
 // OUT: Displays who is next in the queue.
 
-void removePatientCmd(PatientPriorityQueue &);
-// Removes a patient from the waiting room and displays the name on the screen.
-// IN: Takes in priority queue
-// MODIFY: Removes the root of the PriorityQueue
-// OUT: Displays which patient object was removed
+void removePatientCmd(string, PatientPriorityQueue &);
+// Removes the next patient from the waiting room, or the next number of
+// patients if a number follows the command, and displays their names.
+// IN: Takes in the string sans command and priority queue
+// MODIFY: Removes the patients at the top of the PriorityQueue
+// OUT: Displays which Patient objects were removed. Can display an error
+//      message if the number is not a positive number
 
 void showPatientListCmd(PatientPriorityQueue &);
 // Displays the list of patients in the waiting room.
@@ -74,9 +86,17 @@ void showPatientListCmd(PatientPriorityQueue &);
 // MODIFY: none
 // OUT: Displays which Patients are currently in the PriorityQueue.
 
+void showStatsCmd(PatientPriorityQueue &);
+// Displays how much memory the waiting room is using.
+// IN: Takes in priority queue
+// MODIFY: none
+// OUT: Displays the bytes allocated for the queue and for long names, how
+//      many of them are slack, and the statistics of the record pool.
+
 void execCommandsFromFileCmd(string, PatientPriorityQueue &);
 // Reads a text file with each command on a separate line and executes the
-// lines as if they were typed into the command prompt.
+// lines as if they were typed into the command prompt. Runs of add commands
+// next to each other are added to the queue all at once.
 // IN: Takes in priority queue and the string that is the filename to be loaded.
 // MODIFY: Can execute any available commands based on what is in the file.
 // OUT: Display what is done with the PriorityQueue.
@@ -135,9 +155,12 @@ bool processLine(string line, PatientPriorityQueue &priQueue) {
     else if (cmd == "peek")
         peekNextCmd(priQueue);
     else if (cmd == "next")
-        removePatientCmd(priQueue);
+        //A command without a space is left in the line by delimitBySpace
+        removePatientCmd(line == cmd ? "" : line, priQueue);
     else if (cmd == "list")
         showPatientListCmd(priQueue);
+    else if (cmd == "stats")
+        showStatsCmd(priQueue);
     else if (cmd == "load")
         execCommandsFromFileCmd(line, priQueue);
     else if (cmd == "quit")
@@ -149,15 +172,24 @@ bool processLine(string line, PatientPriorityQueue &priQueue) {
 }
 
 void addPatientCmd(string line, PatientPriorityQueue &priQueue) {
-    string priority, name;
+    string name;
     int priorityNo;
 
+    if (readAddCmd(line, name, priorityNo)) {
+        priQueue.add(name, priorityNo);
+        cout << "\nAdded patient \"" << name << "\" to the priority system.\n";
+    }
+}
+
+bool readAddCmd(string line, string &name, int &priorityNo) {
+    string priority;
+
     //The logic to remove spaces must be before the call to delimitByspace
     line = removeLeadingTrailingSpaces(line);
     priority = delimitBySpace(line);
     if (priority.length() == 0) {
         cout << "Error: no priority code given.\n";
-        return;
+        return false;
     }
 
     //The logic to remove spaces must be before the call to delimitBySpace
@@ -167,10 +199,9 @@ void addPatientCmd(string line, PatientPriorityQueue &priQueue) {
     //Need to add more conditionals since the original if you typed out "add
     // urgent" it still added patient "urgent" to the priority system with
     // urgent priority.
-    if (name.length() == 0 || name == "urgent" || name == "emergency" || name
-    == "immediate" || name == "minimal") {
+    if (name.length() == 0 || findPriorityCode(name) != -1) {
         cout << "Error: no patient name given.\n";
-        return;
+        return false;
     }
 
     // TODO: add logic to remove leading/trailing spaces
@@ -182,37 +213,63 @@ void addPatientCmd(string line, PatientPriorityQueue &priQueue) {
 
     // TODO: add patient
     //Only adds to the queue if it is a valid command
-    if (priorityNo != -1) {
-        priQueue.add(name, priorityNo);
-        cout << "\nAdded patient \"" << name << "\" to the priority system.\n";
-   }
-
-
-
+    return priorityNo != -1;
 }
 
 void peekNextCmd(PatientPriorityQueue &priQueue) {
     // TODO: shows next patient to be seen
 
-    //Prints out the peeked (next Patient) in the PriorityQueue
+    //Prints out the peeked (next Patient) in the PriorityQueue without
+    // copying the name
     cout << "Highest priority patient to be called next: " << priQueue.peek()
-    .getPatientName() << endl;
+    .getNameView() << endl;
 }
 
-void removePatientCmd(PatientPriorityQueue &priQueue) {
+void removePatientCmd(string line, PatientPriorityQueue &priQueue) {
     // TODO: removes and shows next patient to be seen
 
-    //If there is no Patient in the priority queue then display message
-    if(priQueue.size() == 0) {
-        cout << "There are no patients in the waiting area.\n";
-    } else {
+    //No number means one patient, which is the only one that can be seen
+    // straight from the queue without being removed first
+    line = removeLeadingTrailingSpaces(line);
+    if (line.empty()) {
+
+        //If there is no Patient in the priority queue then display message
+        if(priQueue.size() == 0) {
+            cout << "There are no patients in the waiting area.\n";
+        } else {
+
+            //If there are Patient in the queue it is printed out who is
+            // removed and then removed, so the name does not have to be
+            // copied out
+            cout << "This patient will now be seen: "
+                 << priQueue.peek().getNameView() << endl;
+            priQueue.pop();
+        }
+        return;
+    }
 
-        //If there are Patient in the queue it is removed and printed out who
-        // is removed
-        cout << "This patient will now be seen: "
-             << priQueue.remove().getPatientName() << endl;
+    //The number has to be all digits, and not so long it overflows
+    if (line.find_first_not_of("0123456789") != string::npos ||
+        line.length() > 9 || stoi(line) == 0) {
+        cout << "Error: the number of patients must be a positive number.\n";
+        return;
     }
 
+    //Remove the whole batch at once and write the names out in one go
+    static vector<Patient> batch;
+    static string output;
+    batch.clear();
+    output.clear();
+    int count = stoi(line);
+    priQueue.removeN(count, batch);
+    for (const Patient &patient : batch) {
+        output += "This patient will now be seen: ";
+        output += patient.getNameView();
+        output += '\n';
+    }
+    if ((int) batch.size() < count)
+        output += "There are no patients in the waiting area.\n";
+    cout.write(output.data(), output.size());
 }
 
 void showPatientListCmd(PatientPriorityQueue &priQueue) {
@@ -221,22 +278,62 @@ void showPatientListCmd(PatientPriorityQueue &priQueue) {
          << "+-----------+---------------+--------------+\n";
     // TODO: shows patient detail in heap order
 
-    //Simply prints out the priority queue
-    cout << priQueue.to_string();
+    //Formats every row into one buffer that is kept for the next list, so
+    // listing does not allocate unless the list is longer than ever before
+    static string listBuffer;
+    listBuffer.clear();
+    priQueue.appendTo(listBuffer);
+    cout.write(listBuffer.data(), listBuffer.size());
+}
+
+void showStatsCmd(PatientPriorityQueue &priQueue) {
+    MemoryUsage usage = priQueue.memoryUsage();
+    PoolStats pool = priQueue.recordPoolStats();
+
+    //Everything is in bytes except for the record pool
+    cout << "# patients waiting: " << priQueue.size() << endl
+         << "Queue bytes: " << usage.heapBytes << endl
+         << "Name bytes:  " << usage.nameBytes << endl
+         << "Slack bytes: " << usage.slackBytes << endl
+         << "Record pool: " << pool.capacity << " records in " << pool.slabs
+         << " slabs, " << pool.recycled << " of " << pool.acquired
+         << " recycled\n";
 }
 
 void execCommandsFromFileCmd(string filename, PatientPriorityQueue &priQueue) {
     ifstream infile;
-    string line;
+    string line, cmd, name;
+    int priorityNo;
+
+    //The patients of the current run of add commands
+    vector<pair<string, int>> intake;
 
     // open and read from file
     infile.open(filename);
     if (infile) {
         while (getline(infile, line)) {
             cout << "\ntriage>" << line;
+
+            //Hold on to the patients of add commands until the run ends
+            string arguments = line;
+            cmd = delimitBySpace(arguments);
+            if (cmd == "add") {
+                if (readAddCmd(arguments, name, priorityNo)) {
+                    cout << "\nAdded patient \"" << name
+                         << "\" to the priority system.\n";
+                    intake.emplace_back(std::move(name), priorityNo);
+                }
+                continue;
+            }
+
+            //Any other command has to see the patients added before it
+            priQueue.addRange(intake.begin(), intake.end());
+            intake.clear();
+
             // process file input
             processLine(line, priQueue);
         }
+        priQueue.addRange(intake.begin(), intake.end());
     } else {
         cout << "Error: could not open file.\n";
     }
@@ -283,9 +380,11 @@ void help() {
          << "            <patient-name>: patient's full legal name (may contain spaces)\n"
          << "next        Announces the patient to be seen next. Takes into account the\n"
          << "            type of emergency and the patient's arrival order.\n"
+         << "next <n>    Announces the next n patients to be seen, in order.\n"
          << "peek        Displays the patient that is next in line, but keeps in queue\n"
          << "list        Displays the list of all patients that are still waiting\n"
          << "            in the order that they have arrived.\n"
+         << "stats       Displays how much memory the waiting room is using\n"
          << "load <file> Reads the file and executes the command on each line\n"
          << "help        Displays this menu\n"
          << "quit        Exits the program\n";
@@ -295,20 +394,8 @@ int validatePriority(string priorityCode) {
 
     //Checks to see if the command is written correctly. If not return
     // negative one.
-    int priorityNo;
-    if(priorityCode == "immediate") {
-        priorityNo = 1;
-
-    } else if(priorityCode == "emergency") {
-        priorityNo = 2;
-
-    } else if(priorityCode == "urgent") {
-        priorityNo = 3;
-
-    } else if(priorityCode == "minimal") {
-        priorityNo = 4;
-
-    } else {
+    int priorityNo = findPriorityCode(priorityCode);
+    if (priorityNo == -1) {
         cout << "Invalid priority code.\n";
         return -1;
     }
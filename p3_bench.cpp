@@ -0,0 +1,896 @@
+// Name: Phubeth Mettaprasert
+// File: p3_bench.cpp
+// Date: May 29th, 2022
+// Purpose: Benchmarks for the priority queues used by the triage program.
+//          Each benchmark fills a queue with simulated patients and then
+//          calls every patient, timing how long it takes.
+// Input: Optionally the largest number of patients to simulate as the first
+//        argument, so the 10 million patient runs can be skipped on small
+//        machines.
+// Process: Builds the same random intake for every queue that is compared
+//          so the results can be compared to each other.
+// Output: Prints a table of the time taken for each queue and size, and the
+//         number of allocations each patient costs over its lifetime.
+
+#include "BucketPatientQueue.h"
+#include "ConcurrentPatientQueue.h"
+#include "LockFreeBucketQueue.h"
+#include "MappedPatientPriorityQueue.h"
+#include "MinKeySelect.h"
+#include "PairingPatientQueue.h"
+#include "PatientPriorityQueue.h"
+#include "PatientQueueEngine.h"
+#include "RadixPatientQueue.h"
+#include "ShardedPatientQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+// Every allocation in the program goes through these so the benchmarks can
+// count them.
+// They are kept out of line, or GCC sees malloc and free on both sides of
+// a new and delete pair and warns that they do not match.
+static atomic<long long> allocationCount(0);
+
+[[gnu::noinline]] void *operator new(size_t size) {
+    allocationCount++;
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+[[gnu::noinline]] void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+//The record slabs are over-aligned and new_delete_resource always asks for
+// an alignment, so the aligned forms have to be counted too
+[[gnu::noinline]] void *operator new(size_t size, align_val_t alignment) {
+    allocationCount++;
+
+    //aligned_alloc needs a size that is a multiple of the alignment
+    size_t align = (size_t) alignment;
+    size_t rounded = (size == 0 ? 1 : size + align - 1) / align * align;
+    void *memory = aligned_alloc(align, rounded);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+[[gnu::noinline]] void operator delete(void *memory, align_val_t) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, size_t,
+                                       align_val_t) noexcept {
+    free(memory);
+}
+
+
+struct Intake {
+    vector<string> names; //The name of every simulated patient
+    vector<int> priorityCodes; //The priority code of every simulated patient
+};
+
+struct Trace {
+    vector<string> names; //The name of the patient of every add
+    vector<int> operations; //A priority code to add a patient, or 0 for next
+};
+
+//The way to share the heap between threads before ConcurrentPatientQueue:
+// the single-threaded heap behind one mutex, which copies the name in and
+// out of the queue while holding it
+class LockedPatientPriorityQueue {
+public:
+    void add(string, int);
+    // Adds the Patient to the heap while holding the lock.
+    // IN: The name and priority code of the Patient.
+    // MODIFY: The heap.
+    // OUT: none
+
+    PatientPtr tryRemove();
+    // Removes the next Patient while holding the lock.
+    // IN: none
+    // MODIFY: The heap.
+    // OUT: Returns the Patient, or a null pointer if the heap was empty.
+
+    string to_string();
+    // Formats the list while holding the lock, the only way a dashboard
+    // could read a consistent list of the heap.
+    // IN: none
+    // MODIFY: none
+    // OUT: Returns the list.
+
+private:
+    mutex lock; //Held for every operation on the heap
+    PatientPriorityQueue queue; //The heap shared by every thread
+};
+
+//The binary heap with tryRemove like ConcurrentPatientQueue, so the two can
+// be timed by the same template
+class HeapForBatches : public PatientPriorityQueue {
+public:
+    Patient tryRemove();
+    // Removes the next Patient.
+    // IN: none
+    // MODIFY: The heap.
+    // OUT: Returns the Patient.
+};
+
+Intake makeIntake(int);
+// Creates a random intake of patients with a fixed seed.
+// IN: The number of patients in the intake.
+// MODIFY: none
+// OUT: Returns the names and priority codes of the patients.
+
+Trace makeTrace(int);
+// Creates a random trace of adds and nexts with a fixed seed. Three out of
+// five operations are adds, so the queue grows as it churns, and the queue
+// is emptied at the end of the trace.
+// IN: The number of adds in the trace.
+// MODIFY: none
+// OUT: Returns the operations of the trace.
+
+template <class Engine>
+double timeTrace(const Trace &);
+// Runs the trace on an empty queue of the engine.
+// IN: The trace of operations.
+// MODIFY: none
+// OUT: Returns the time taken in milliseconds.
+
+template <class Queue>
+double timeAddThenRemove(const Intake &);
+// Adds every patient of the intake to an empty queue and then removes them
+// all again.
+// IN: The intake of patients.
+// MODIFY: none
+// OUT: Returns the time taken in milliseconds.
+
+template <class Queue>
+double timeAdd(const Intake &);
+// Adds every patient of the intake to an empty queue, which is where the
+// storage of the heap grows.
+// IN: The intake of patients.
+// MODIFY: none
+// OUT: Returns the time taken in milliseconds.
+
+template <class Queue>
+double timeDesks(int, int);
+// Starts the number of threads on a queue that already has patients
+// waiting, and has each thread add a patient and then remove the next one
+// over and over, like desks and clinicians working at the same time.
+// IN: The number of threads and the number of add/remove cycles shared
+//     between them.
+// MODIFY: none
+// OUT: Returns the time taken in milliseconds from when every thread is
+//      started until the last one is done.
+
+double timeClinicians(int, int, bool);
+// Starts the number of clinician threads on an empty ConcurrentPatientQueue
+// and has one desk add a patient every 50 microseconds, while every
+// clinician takes the next patient either by waiting in waitAndRemove or by
+// polling tryRemove.
+// IN: The number of clinicians, the number of patients and whether the
+//     clinicians wait instead of polling.
+// MODIFY: none
+// OUT: Returns the processor time the program used in milliseconds until
+//      every patient is seen.
+
+double timeShards(int, int, long long &);
+// Same as timeDesks on a ShardedPatientQueue of three departments. Every
+// thread works in the department of its number modulo three, adding
+// patients with the codes that department sees most and removing the next
+// patient through its home shard.
+// IN: The number of threads and the number of add/remove cycles shared
+//     between them.
+// MODIFY: The number of patients stolen from another department.
+// OUT: Returns the time taken in milliseconds.
+
+template <class Queue>
+double timeDeskWhileListing(int, int, bool, double &);
+// Has one desk add a patient and remove the next one over and over on a
+// queue that already has patients waiting, while a dashboard thread lists
+// the queue every 10 milliseconds, and times every cycle of the desk.
+// IN: The number of patients waiting, the number of cycles and whether the
+//     dashboard is running.
+// MODIFY: The time of the slowest cycle in microseconds.
+// OUT: Returns the time of the 99.9th percentile cycle in microseconds.
+
+void benchmarkArity(const vector<int> &);
+// Compares the binary, 4-ary and 8-ary heaps for every intake size.
+// IN: The sizes of the intakes to simulate.
+// MODIFY: none
+// OUT: Displays the time taken by each heap.
+
+void benchmarkEngines(const vector<int> &);
+// Runs every queue engine on the same trace for every trace size.
+// IN: The number of adds of the traces to simulate.
+// MODIFY: none
+// OUT: Displays the time taken by each engine.
+
+void benchmarkStorage(const vector<int> &);
+// Compares the binary heap backed by vectors with the one backed by
+// MappedArrays while the intake is added.
+// IN: The sizes of the intakes to simulate.
+// MODIFY: none
+// OUT: Displays the time taken by each storage.
+
+void benchmarkContention(int);
+// Compares the heap behind one mutex with ConcurrentPatientQueue and the
+// LockFreeBucketQueue as the number of threads sharing the queue goes from
+// 1 to 64.
+// IN: The number of add/remove cycles shared by the threads.
+// MODIFY: none
+// OUT: Displays the time taken by each queue for each number of threads.
+
+void benchmarkSharding(int);
+// Compares one ConcurrentPatientQueue shared by every thread with a
+// ShardedPatientQueue of three departments as the number of threads goes
+// from 3 to 48.
+// IN: The number of add/remove cycles shared by the threads.
+// MODIFY: none
+// OUT: Displays the time taken by each queue for each number of threads and
+//      the share of the patients that were stolen.
+
+void benchmarkWakeups(int);
+// Compares the processor time of clinicians that poll an empty queue with
+// clinicians that wait in waitAndRemove while one desk adds the patients
+// slower than the clinicians can see them.
+// IN: The number of patients the desk adds.
+// MODIFY: none
+// OUT: Displays the time taken by each way for each number of clinicians.
+
+void benchmarkSnapshots(int);
+// Compares the latency of the desk while a dashboard lists the queue, on the
+// heap behind one mutex, which has to be formatted under the lock, and on
+// ConcurrentPatientQueue, which is listed from a snapshot.
+// IN: The number of patients waiting.
+// MODIFY: none
+// OUT: Displays the 99.9th percentile and the slowest cycle of the desk
+//      with and without the dashboard.
+
+void benchmarkMinOfEight();
+// Times finding the smallest of 8 order keys with the scalar loop and with
+// AVX2, as siftDown of the 8-ary heap does at every level.
+// IN: none
+// MODIFY: none
+// OUT: Displays the time taken by each way.
+
+void reportSurgeMemory(int, int);
+// Shows the memory a queue holds at the peak of a surge of patients and
+// after the surge drains, when the shrink policy gives most of it back.
+// IN: The number of patients in the surge and the number left waiting.
+// MODIFY: none
+// OUT: Displays the memory usage of the queue at both points.
+
+template <class Queue>
+double timeBatches(const Intake &, int, bool);
+// Adds every patient of the intake to an empty queue and then removes half
+// of them in batches, either with one removeN per batch or with one remove
+// per patient. Only the removing is timed.
+// IN: The intake of patients, the size of a batch and whether to use
+//     removeN.
+// MODIFY: none
+// OUT: Returns the time taken in milliseconds.
+
+void benchmarkRemoveN(int);
+// Compares removing patients in batches with removeN against removing them
+// one at a time, on the heap and on ConcurrentPatientQueue, for batches from
+// one patient up to half of the queue.
+// IN: The number of patients in the queue.
+// MODIFY: none
+// OUT: Displays the time taken by each way for each batch size.
+
+void benchmarkList(int);
+// Times rendering the list of a queue the way the list command does, into
+// one reused buffer, against formatting every row with a stringstream and
+// setw like the rows used to be formatted.
+// IN: The number of patients waiting.
+// MODIFY: none
+// OUT: Displays the time taken by each way and the allocations of the
+//      buffer once it is warm.
+
+template <class Queue>
+void runSession(Queue &, int);
+// Runs one triage session: the patients arrive, every tenth one leaves
+// before being seen, and the rest are seen in order. Every fourth name is
+// too long to fit in a record.
+// IN: The number of patients in the session.
+// MODIFY: The queue, which ends up empty.
+// OUT: none
+
+void benchmarkPmr(int, int);
+// Times sessions on a queue using the default allocator against sessions on
+// a PmrPatientPriorityQueue that allocates everything, including the names
+// it hands back, from a monotonic buffer that is thrown away in one go at
+// the end of each session.
+// IN: The number of sessions and the number of patients in each.
+// MODIFY: none
+// OUT: Displays the time taken and the allocations of each way.
+
+
+int main(int argc, char *argv[]) {
+    // the largest intake can be lowered from the command line
+    long maxPatients = 10000000;
+    if (argc > 1)
+        maxPatients = atol(argv[1]);
+
+    vector<int> sizes;
+    for (int size : {1000, 100000, 10000000}) {
+        if (size <= maxPatients)
+            sizes.push_back(size);
+    }
+
+    benchmarkArity(sizes);
+    benchmarkEngines(sizes);
+    benchmarkStorage(sizes);
+    benchmarkContention(min<long>(maxPatients, 1000000));
+    benchmarkSharding(min<long>(maxPatients, 1000000));
+    benchmarkWakeups(min<long>(maxPatients, 2000));
+    benchmarkSnapshots(min<long>(maxPatients, 100000));
+    benchmarkMinOfEight();
+    reportSurgeMemory(min<long>(maxPatients, 1000000), 100);
+    benchmarkList(min<long>(maxPatients, 1000000));
+    benchmarkRemoveN(min<long>(maxPatients, 1000000));
+    benchmarkPmr(20, min<long>(maxPatients, 100000));
+    return 0;
+}
+
+Intake makeIntake(int patients) {
+    Intake intake;
+    mt19937 random(2022);
+    uniform_int_distribution<int> priority(1, 4);
+
+    intake.names.reserve(patients);
+    intake.priorityCodes.reserve(patients);
+    for (int i = 0; i < patients; i++) {
+        intake.names.push_back("P" + std::to_string(i));
+        intake.priorityCodes.push_back(priority(random));
+    }
+    return intake;
+}
+
+Trace makeTrace(int adds) {
+    Trace trace;
+    mt19937 random(2022);
+    uniform_int_distribution<int> operation(1, 5);
+    uniform_int_distribution<int> priority(1, 4);
+
+    int waiting = 0;
+    for (int added = 0; added < adds;) {
+        if (operation(random) <= 3 || waiting == 0) {
+            trace.names.push_back("P" + std::to_string(added));
+            trace.operations.push_back(priority(random));
+            waiting++;
+            added++;
+        } else {
+            trace.operations.push_back(0);
+            waiting--;
+        }
+    }
+    trace.operations.insert(trace.operations.end(), waiting, 0);
+    return trace;
+}
+
+template <class Engine>
+double timeTrace(const Trace &trace) {
+    requirePatientQueueEngine<Engine>();
+    Engine queue;
+    int nextName = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int operation : trace.operations) {
+        if (operation == 0)
+            queue.remove();
+        else
+            queue.add(trace.names[nextName++], operation);
+    }
+    auto stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+template <class Queue>
+double timeAddThenRemove(const Intake &intake) {
+    Queue queue;
+    int patients = intake.names.size();
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < patients; i++)
+        queue.add(intake.names[i], intake.priorityCodes[i]);
+    while (queue.size() > 0)
+        queue.remove();
+    auto stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+template <class Queue>
+double timeAdd(const Intake &intake) {
+    Queue queue;
+    int patients = intake.names.size();
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < patients; i++)
+        queue.add(intake.names[i], intake.priorityCodes[i]);
+    auto stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+void LockedPatientPriorityQueue::add(string name, int priorityCode) {
+    lock_guard<mutex> guard(lock);
+    queue.add(name, priorityCode);
+}
+
+PatientPtr LockedPatientPriorityQueue::tryRemove() {
+    lock_guard<mutex> guard(lock);
+    if (queue.size() == 0)
+        return PatientPtr();
+    return make_shared<const Patient>(queue.remove());
+}
+
+string LockedPatientPriorityQueue::to_string() {
+    lock_guard<mutex> guard(lock);
+    return queue.to_string();
+}
+
+Patient HeapForBatches::tryRemove() {
+    return remove();
+}
+
+template <class Queue>
+double timeDesks(int threads, int cycles) {
+    Queue queue;
+    for (int i = 0; i < 1000; i++)
+        queue.add("Waiting patient " + std::to_string(i), i % 4 + 1);
+
+    //Every thread waits for the others to be started before it begins
+    atomic<bool> go(false);
+    vector<thread> desks;
+    for (int t = 0; t < threads; t++) {
+        desks.emplace_back([&queue, &go, t, threads, cycles]() {
+            string name = "Patient from desk " + std::to_string(t);
+            while (!go.load(memory_order_acquire))
+                this_thread::yield();
+            for (int i = t; i < cycles; i += threads) {
+                queue.add(name, i % 4 + 1);
+                queue.tryRemove();
+            }
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    for (thread &desk : desks)
+        desk.join();
+    auto stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+double timeShards(int threads, int cycles, long long &steals) {
+
+    //The emergency room sees the most urgent codes and the fast-track clinic
+    // the least urgent, so the departments steal from each other
+    const int DEPARTMENTS = 3;
+    const int departmentCodes[DEPARTMENTS][4] = {
+            {1, 2, 2, 3}, {2, 3, 3, 4}, {3, 4, 4, 4}};
+    ShardedPatientQueue queue(DEPARTMENTS);
+    for (int i = 0; i < 1000; i++) {
+        int department = i % DEPARTMENTS;
+        queue.add(department, "Waiting patient " + std::to_string(i),
+                  departmentCodes[department][i / DEPARTMENTS % 4]);
+    }
+
+    atomic<bool> go(false);
+    vector<thread> clinicians;
+    for (int t = 0; t < threads; t++) {
+        clinicians.emplace_back([&, t]() {
+            int home = t % DEPARTMENTS;
+            string name = "Patient from desk " + std::to_string(t);
+            while (!go.load(memory_order_acquire))
+                this_thread::yield();
+            for (int i = t; i < cycles; i += threads) {
+                queue.add(home, name, departmentCodes[home][i % 4]);
+                queue.tryRemove(home);
+            }
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    for (thread &clinician : clinicians)
+        clinician.join();
+    auto stop = chrono::steady_clock::now();
+
+    steals = queue.getSteals();
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+double timeClinicians(int clinicians, int patients, bool wait) {
+    ConcurrentPatientQueue queue;
+    atomic<int> seen(0);
+
+    clock_t start = clock();
+    vector<thread> staff;
+    for (int c = 0; c < clinicians; c++) {
+        staff.emplace_back([&queue, &seen, patients, wait]() {
+            while (seen.load(memory_order_relaxed) < patients) {
+                PatientPtr next;
+                if (wait)
+                    next = queue.waitAndRemoveFor(chrono::milliseconds(10));
+                else
+                    next = queue.tryRemove();
+                if (next != nullptr)
+                    seen.fetch_add(1, memory_order_relaxed);
+                else if (!wait)
+                    this_thread::yield();
+            }
+        });
+    }
+
+    //The desk adds the patients one at a time as they arrive
+    string name = "Patient at the desk";
+    for (int i = 0; i < patients; i++) {
+        this_thread::sleep_for(chrono::microseconds(50));
+        queue.add(name, i % 4 + 1);
+    }
+    for (thread &clinician : staff)
+        clinician.join();
+    clock_t stop = clock();
+
+    return 1000.0 * (stop - start) / CLOCKS_PER_SEC;
+}
+
+template <class Queue>
+double timeDeskWhileListing(int patients, int cycles, bool dashboard,
+                            double &worst) {
+    Queue queue;
+    for (int i = 0; i < patients; i++)
+        queue.add("Waiting patient " + std::to_string(i), i % 4 + 1);
+
+    //The dashboard lists the queue until the desk is done
+    atomic<bool> done(false);
+    thread screen;
+    if (dashboard) {
+        screen = thread([&queue, &done]() {
+            while (!done.load(memory_order_relaxed)) {
+                string list = queue.to_string();
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+        });
+    }
+
+    vector<double> latencies(cycles);
+    string name = "Patient at the desk";
+    for (int i = 0; i < cycles; i++) {
+        auto start = chrono::steady_clock::now();
+        queue.add(name, i % 4 + 1);
+        queue.tryRemove();
+        auto stop = chrono::steady_clock::now();
+        latencies[i] = chrono::duration<double, micro>(stop - start).count();
+    }
+    done.store(true, memory_order_relaxed);
+    if (dashboard)
+        screen.join();
+
+    sort(latencies.begin(), latencies.end());
+    worst = latencies.back();
+    return latencies[cycles - 1 - cycles / 1000];
+}
+
+void benchmarkArity(const vector<int> &sizes) {
+    cout << "add then remove every patient (ms)\n"
+         << "  Patients      2-ary      4-ary      8-ary\n";
+    for (int size : sizes) {
+        Intake intake = makeIntake(size);
+        cout << setw(10) << size << fixed << setprecision(2)
+             << setw(11) << timeAddThenRemove<BasicPatientPriorityQueue<2>>(intake)
+             << setw(11) << timeAddThenRemove<BasicPatientPriorityQueue<4>>(intake)
+             << setw(11) << timeAddThenRemove<BasicPatientPriorityQueue<8>>(intake)
+             << endl;
+    }
+}
+
+void benchmarkEngines(const vector<int> &sizes) {
+    cout << "\nsame add/next trace on every engine (ms)\n"
+         << "      Adds     binary      4-ary     bucket    pairing      radix\n";
+    for (int size : sizes) {
+        Trace trace = makeTrace(size);
+        cout << setw(10) << size << fixed << setprecision(2)
+             << setw(11) << timeTrace<PatientPriorityQueue>(trace)
+             << setw(11) << timeTrace<BasicPatientPriorityQueue<4>>(trace)
+             << setw(11) << timeTrace<BucketPatientQueue>(trace)
+             << setw(11) << timeTrace<PairingPatientQueue>(trace)
+             << setw(11) << timeTrace<RadixPatientQueue>(trace)
+             << endl;
+    }
+}
+
+void benchmarkStorage(const vector<int> &sizes) {
+    cout << "\nadd every patient to the binary heap (ms)\n"
+         << "  Patients     vector     mapped\n";
+    for (int size : sizes) {
+        Intake intake = makeIntake(size);
+        cout << setw(10) << size << fixed << setprecision(2)
+             << setw(11) << timeAdd<PatientPriorityQueue>(intake)
+             << setw(11) << timeAdd<MappedPatientPriorityQueue<2>>(intake)
+             << endl;
+    }
+}
+
+void benchmarkContention(int cycles) {
+    cout << "\n" << cycles << " add/remove cycles shared by threads (ms), "
+         << thread::hardware_concurrency() << " hardware threads\n"
+         << "   Threads locked heap  concurrent   lock-free\n";
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        double locked = timeDesks<LockedPatientPriorityQueue>(threads, cycles);
+        double concurrent = timeDesks<ConcurrentPatientQueue>(threads, cycles);
+        double lockFree = timeDesks<LockFreeBucketQueue>(threads, cycles);
+        cout << setw(10) << threads << setw(12) << locked << setw(12)
+             << concurrent << setw(12) << lockFree << endl;
+    }
+}
+
+void benchmarkSharding(int cycles) {
+    cout << "\n" << cycles << " add/remove cycles, one queue or one shard "
+         << "per department (ms)\n"
+         << "   Threads   one queue    3 shards      stolen\n";
+    for (int threads : {3, 6, 12, 24, 48}) {
+        long long steals = 0;
+        double one = timeDesks<ConcurrentPatientQueue>(threads, cycles);
+        double sharded = timeShards(threads, cycles, steals);
+        cout << setw(10) << threads << setw(12) << one << setw(12) << sharded
+             << setw(11) << 100.0 * steals / cycles << "%" << endl;
+    }
+}
+
+void benchmarkWakeups(int patients) {
+    cout << "\nprocessor time while one desk adds " << patients
+         << " patients 50 us apart (ms)\n"
+         << "Clinicians     polling     waiting\n";
+    for (int clinicians : {1, 4, 16, 64}) {
+        double polling = timeClinicians(clinicians, patients, false);
+        double waiting = timeClinicians(clinicians, patients, true);
+        cout << setw(10) << clinicians << setw(12) << polling << setw(12)
+             << waiting << endl;
+    }
+}
+
+void benchmarkSnapshots(int patients) {
+    const int cycles = 200000;
+    cout << "\ndesk add/next latency with " << patients
+         << " waiting while a dashboard lists every 10 ms (us), "
+         << thread::hardware_concurrency() << " hardware threads\n"
+         << "     Queue  Dashboard     99.9%      worst\n";
+    for (bool dashboard : {false, true}) {
+        double worst = 0;
+        double locked = timeDeskWhileListing<LockedPatientPriorityQueue>(
+                patients, cycles, dashboard, worst);
+        cout << setw(10) << "locked" << setw(11) << (dashboard ? "on" : "off")
+             << setw(10) << locked << setw(11) << worst << endl;
+        double snapshot = timeDeskWhileListing<ConcurrentPatientQueue>(
+                patients, cycles, dashboard, worst);
+        cout << setw(10) << "snapshot" << setw(11)
+             << (dashboard ? "on" : "off") << setw(10) << snapshot
+             << setw(11) << worst << endl;
+    }
+}
+
+void benchmarkMinOfEight() {
+    const int groups = 1 << 16;
+    const int passes = 200;
+
+    //Order keys of random patients, 8 children to a group
+    mt19937 random(2022);
+    uniform_int_distribution<int> priority(1, 4);
+    uniform_int_distribution<int> arrival(0, 1 << 30);
+    vector<uint64_t> keys(groups * 8);
+    for (uint64_t &key : keys)
+        key = Patient::makeOrderKey(priority(random), arrival(random));
+
+    //The sum of the offsets keeps the compiler from skipping the work
+    long long scalarSum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (int group = 0; group < groups; group++)
+            scalarSum += minKeyScalar(&keys[group * 8], 8);
+    }
+    auto stop = chrono::steady_clock::now();
+    double scalarTime = chrono::duration<double, milli>(stop - start).count();
+
+    cout << "\nsmallest of 8 children, " << (long long) groups * passes
+         << " selections (ms)\n" << fixed << setprecision(2)
+         << "    scalar: " << setw(10) << scalarTime << endl;
+
+#ifdef P3_HAVE_AVX2_SELECT
+    if (hasAvx2()) {
+        long long avx2Sum = 0;
+        start = chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; pass++) {
+            for (int group = 0; group < groups; group++)
+                avx2Sum += minOfEightKeysAvx2(&keys[group * 8]);
+        }
+        stop = chrono::steady_clock::now();
+        double avx2Time = chrono::duration<double, milli>(stop - start).count();
+        cout << "      AVX2: " << setw(10) << avx2Time << "  ("
+             << scalarTime / avx2Time << "x)" << endl;
+        if (avx2Sum != scalarSum)
+            cout << "      AVX2 picked different children than the scalar loop\n";
+        return;
+    }
+#endif
+    cout << "      AVX2: not supported by this processor\n";
+}
+
+void reportSurgeMemory(int surge, int left) {
+    PatientPriorityQueue queue;
+    string name(60, 'x');
+    for (int i = 0; i < surge; i++)
+        queue.add(name, i % 4 + 1);
+
+    auto report = [&queue](const char *when) {
+        MemoryUsage usage = queue.memoryUsage();
+        cout << when << ": " << queue.size() << " waiting, "
+             << usage.heapBytes / 1024 << " KB queue, "
+             << usage.nameBytes / 1024 << " KB names, "
+             << usage.slackBytes / 1024 << " KB slack\n";
+    };
+    report("\nsurge peak");
+    while (queue.size() > left)
+        queue.pop();
+    report("after drain");
+}
+
+void benchmarkList(int patients) {
+    PatientPriorityQueue queue;
+    for (int i = 0; i < patients; i++)
+        queue.add("Patient " + std::to_string(i), i % 4 + 1);
+
+    //The old way: a stringstream per row, copied into one for the list
+    auto start = chrono::steady_clock::now();
+    stringstream list;
+    queue.forEach([&list](const PatientRecord &patient) {
+        stringstream row;
+        row << setw(6) << (patient.getArrivalOrder() + 1) << "          "
+            << setw(15) << left << patient.getPriorityInString() << left
+            << patient.getNameView() << "\n";
+        list << row.str();
+    });
+    string oldList = list.str();
+    auto stop = chrono::steady_clock::now();
+    double streamTime = chrono::duration<double, milli>(stop - start).count();
+
+    //The list command: the first list grows the buffer, the second reuses it
+    string buffer;
+    queue.appendTo(buffer);
+    buffer.clear();
+    long long before = allocationCount;
+    start = chrono::steady_clock::now();
+    queue.appendTo(buffer);
+    stop = chrono::steady_clock::now();
+    double bufferTime = chrono::duration<double, milli>(stop - start).count();
+
+    cout << "\nlist of " << patients << " patients (ms)\n"
+         << "stringstream: " << setw(10) << streamTime << endl
+         << "      buffer: " << setw(10) << bufferTime << "  ("
+         << allocationCount - before << " allocations, "
+         << (buffer == oldList ? "same" : "different") << " text)\n";
+}
+
+template <class Queue>
+double timeBatches(const Intake &intake, int batchSize, bool batched) {
+    Queue queue;
+    int patients = intake.names.size();
+    for (int i = 0; i < patients; i++)
+        queue.add(intake.names[i], intake.priorityCodes[i]);
+
+    //Both ways fill the same kind of buffer, which is reused for each batch
+    typedef decltype(queue.tryRemove()) Removed;
+    vector<Removed> batch;
+    auto start = chrono::steady_clock::now();
+    for (int removed = 0; removed < patients / 2; removed += batchSize) {
+        int count = min(batchSize, patients / 2 - removed);
+        batch.clear();
+        if (batched) {
+            queue.removeN(count, batch);
+        } else {
+            for (int i = 0; i < count; i++)
+                batch.push_back(queue.tryRemove());
+        }
+    }
+    auto stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+void benchmarkRemoveN(int patients) {
+    Intake intake = makeIntake(patients);
+    cout << "\nremove half of " << patients << " patients in batches (ms)\n"
+         << "     Batch   heap: one  heap: batch  conc: one  conc: batch\n";
+    for (int batchSize : {1, 10, 1000, patients / 4, patients / 2}) {
+        cout << setw(10) << batchSize
+             << setw(11) << timeBatches<HeapForBatches>(intake, batchSize,
+                                                        false)
+             << setw(13) << timeBatches<HeapForBatches>(intake, batchSize,
+                                                        true)
+             << setw(11) << timeBatches<ConcurrentPatientQueue>(
+                     intake, batchSize, false)
+             << setw(13) << timeBatches<ConcurrentPatientQueue>(
+                     intake, batchSize, true)
+             << endl;
+    }
+}
+
+template <class Queue>
+void runSession(Queue &queue, int patients) {
+    string shortName(20, 's');
+    string longName(80, 'l');
+    vector<PatientHandle> handles;
+    handles.reserve(patients);
+    for (int i = 0; i < patients; i++)
+        handles.push_back(queue.add(i % 4 == 0 ? longName : shortName,
+                                    i % 4 + 1));
+    for (int i = 0; i < patients; i += 10)
+        queue.cancel(handles[i]);
+    while (queue.size() > 0)
+        queue.remove();
+}
+
+void benchmarkPmr(int sessions, int patients) {
+
+    //The default allocator goes to the global heap for every container
+    long long before = allocationCount;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < sessions; i++) {
+        PatientPriorityQueue queue;
+        runSession(queue, patients);
+    }
+    auto stop = chrono::steady_clock::now();
+    double defaultTime = chrono::duration<double, milli>(stop - start).count();
+    long long defaultAllocations = allocationCount - before;
+
+    //Every session gets a fresh monotonic resource over one buffer that is
+    // big enough for the whole session, so nothing is freed one by one
+    vector<char> buffer(patients * 1024);
+    before = allocationCount;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < sessions; i++) {
+        pmr::monotonic_buffer_resource session(buffer.data(), buffer.size());
+        PmrPatientPriorityQueue<2> queue(&session);
+        runSession(queue, patients);
+    }
+    stop = chrono::steady_clock::now();
+    double pmrTime = chrono::duration<double, milli>(stop - start).count();
+    long long pmrAllocations = allocationCount - before;
+
+    //The names and the handles of a session are allocated outside the queue
+    cout << "\n" << sessions << " sessions of " << patients
+         << " patients (ms)\n"
+         << "  default: " << setw(10) << defaultTime << "  ("
+         << defaultAllocations << " allocations)\n"
+         << "monotonic: " << setw(10) << pmrTime << "  ("
+         << pmrAllocations << " allocations)\n";
+}
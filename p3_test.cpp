@@ -0,0 +1,946 @@
+// Name: Phubeth Mettaprasert
+// File: p3_test.cpp
+// Date: May 29th, 2022
+// Purpose: Tests for the behavior of the priority queues that the triage
+//          program and the benchmarks rely on but never check themselves.
+// Input: none
+// Process: Runs every queue against a simpler way of getting the same
+//          answer, such as removing one patient at a time, on random
+//          patients with a fixed seed. Counts every allocation of the
+//          program to check the paths that should not allocate.
+// Output: Prints one line for each test and returns a non-zero exit code if
+//         any of them failed.
+
+#include "ConcurrentPatientQueue.h"
+#include "LockFreeBucketQueue.h"
+#include "MappedPatientPriorityQueue.h"
+#include "PatientPriorityQueue.h"
+#include "ShardedPatientQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+// Every allocation in the tests goes through these so the tests can check
+// that the queues do not allocate where they should not.
+// They are kept out of line, or GCC sees malloc and free on both sides of
+// a new and delete pair and warns that they do not match.
+static atomic<long long> allocationCount(0);
+
+[[gnu::noinline]] void *operator new(size_t size) {
+    allocationCount++;
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+[[gnu::noinline]] void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+//The record slabs are over-aligned, so the aligned forms are counted too
+[[gnu::noinline]] void *operator new(size_t size, align_val_t alignment) {
+    allocationCount++;
+
+    //aligned_alloc needs a size that is a multiple of the alignment
+    size_t align = (size_t) alignment;
+    size_t rounded = (size == 0 ? 1 : size + align - 1) / align * align;
+    void *memory = aligned_alloc(align, rounded);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+[[gnu::noinline]] void operator delete(void *memory, align_val_t) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, size_t,
+                                       align_val_t) noexcept {
+    free(memory);
+}
+
+
+template <class Queue>
+bool testRemoveN(int, int, int);
+// Fills two queues with the same patients, cancels and re-triages some of
+// them in both, then removes the batch from one with removeN and from the
+// other with one remove per patient, and compares the Patients and the
+// queues that are left.
+// IN: The number of patients, the size of the batch and the number of
+//     priority codes to draw from, where 1 makes arrival order decide.
+// MODIFY: none
+// OUT: Displays what differed. Returns false if anything did.
+
+template <class Queue>
+bool testRemoveNSizes(const string &);
+// Runs testRemoveN for batches from none to more than the queue holds, so
+// both the popping and the selecting paths of removeN are taken.
+// IN: The name of the queue to display.
+// MODIFY: none
+// OUT: Displays whether every batch matched. Returns false if any did not.
+
+template <class Queue>
+bool testStaleHandle(const string &);
+// Cancels a patient, adds patients until one of them gets the slot of the
+// cancelled one, and then tries contains, cancel and changePriority with
+// the old handle.
+// IN: The name of the queue to display.
+// MODIFY: none
+// OUT: Displays whether the old handle was rejected every time and the new
+//      patient left alone. Returns false if not.
+
+template <class Queue>
+bool testHandlesAgainstMap(const string &, int);
+// Adds, removes, cancels and re-triages patients at random, using handles
+// of patients that are waiting as well as of ones that left long ago, and
+// checks every answer against a map ordered by (code, arrival order).
+// IN: The name of the queue to display and the number of operations.
+// MODIFY: none
+// OUT: Displays the first answer that differed. Returns false if any did.
+
+bool testNameAllocations(int);
+// Sends patients with names of every length up to the inline capacity of
+// a record through a queue that has room reserved for all of them. Adding
+// and popping them should not allocate at all once the queue is warm, and
+// removing them should only allocate the names handed back.
+// IN: The number of patients to send through the queue.
+// MODIFY: none
+// OUT: Displays the allocations that should not have happened. Returns
+//      false if there were any.
+
+bool testChurnAllocations(int, int, int);
+// Runs steady add/next churn on a queue that already has patients waiting.
+// Once the record pool and the name arena are warm, adding a patient and
+// popping the next one should not allocate at all, whether the names fit
+// in the records or spill to the arena.
+// IN: The number of patients waiting, the number of add/next cycles and
+//     the length of the names.
+// MODIFY: none
+// OUT: Displays the allocations per cycle. Returns false if a cycle
+//      allocated.
+
+template <class Queue, class Batch>
+void runPmrSession(Queue &, int, Batch &);
+// Runs one triage session: the patients arrive, every tenth one leaves
+// before being seen, a small batch and then three quarters of the rest are
+// removed with removeN, and the rest are removed one at a time. Every
+// fourth name is too long to fit in a record.
+// IN: The number of patients in the session.
+// MODIFY: The queue, which ends up empty, and the batch, which gets every
+//         Patient removed in the order they left.
+// OUT: none
+
+bool testPmrQueue(int);
+// Runs a session on a PmrPatientPriorityQueue over a monotonic buffer that
+// cannot fall back to the heap, and the same session on the binary heap.
+// IN: The number of patients in the session.
+// MODIFY: none
+// OUT: Displays what went wrong. Returns false if the queue allocated
+//      outside the buffer or the Patients differed from the binary heap.
+
+bool testConcurrentQueue(int, int);
+// Adds the same patients to a ConcurrentPatientQueue and to the binary heap
+// from one thread and checks both hand them out in the same order. Then has
+// the number of producer threads add patients while one thread removes
+// them, and removes the rest.
+// IN: The number of producers and the number of patients each adds.
+// MODIFY: none
+// OUT: Displays what went wrong. Returns false if the order differed from
+//      the binary heap, if a patient was lost or seen twice, or if patients
+//      of one producer and code left out of the order they were added in.
+
+bool testWaitAndRemove();
+// Has consumers wait on an empty ConcurrentPatientQueue, with and without a
+// timeout, and adds the patients they wait for only after they started
+// waiting. Also waits with a short timeout on a queue nobody adds to.
+// IN: none
+// MODIFY: none
+// OUT: Displays what went wrong. Returns false if a consumer did not get a
+//      patient added later, or if the short wait did not time out empty.
+
+bool testShardedOrder(int);
+// Adds patients to two of the three shards of a ShardedPatientQueue and to
+// the binary heap, and removes them all for a clinician of the empty
+// shard, who has to steal every one. Then fills all three shards and
+// removes for clinicians of every shard in turn.
+// IN: The number of patients.
+// MODIFY: none
+// OUT: Displays what went wrong. Returns false if the stolen patients left
+//      in another order than the binary heap, or if a less urgent code left
+//      before a more urgent one.
+
+bool testSnapshots(int);
+// Takes a snapshot of a ConcurrentPatientQueue, then adds and removes
+// patients and checks the snapshot still lists what it listed at first.
+// Then has a reader take snapshots while a writer adds and removes.
+// IN: The number of patients.
+// MODIFY: none
+// OUT: Displays what went wrong. Returns false if a snapshot changed after
+//      it was taken, or if one the reader took was not in heap order.
+
+bool testLockFreeArrivalOrder(int, int);
+// Has the number of producer threads add patients to a LockFreeBucketQueue
+// while one thread removes them, and then removes the rest. Every producer
+// adds its patients with codes that repeat, so many patients of one code
+// race into the same ring at once.
+// IN: The number of producers and the number of patients each adds.
+// MODIFY: none
+// OUT: Displays what went wrong. Returns false if a patient was lost or
+//      seen twice, if two patients got the same arrival order, or if
+//      patients of the same code left out of arrival order or out of the
+//      order their producer added them in.
+
+
+int main() {
+    bool passed = testRemoveNSizes<PatientPriorityQueue>("binary heap");
+    passed = testRemoveNSizes<BasicPatientPriorityQueue<4>>("4-ary heap") &&
+             passed;
+    passed = testRemoveNSizes<BasicPatientPriorityQueue<8>>("8-ary heap") &&
+             passed;
+    passed = testRemoveNSizes<MappedPatientPriorityQueue<2>>("mapped heap") &&
+             passed;
+
+    passed = testStaleHandle<PatientPriorityQueue>("binary heap") && passed;
+    passed = testStaleHandle<MappedPatientPriorityQueue<2>>("mapped heap") &&
+             passed;
+    passed = testHandlesAgainstMap<PatientPriorityQueue>("binary heap",
+                                                         200000) && passed;
+    passed = testHandlesAgainstMap<BasicPatientPriorityQueue<4>>("4-ary heap",
+                                                                 200000) &&
+             passed;
+
+    passed = testNameAllocations(10000) && passed;
+    passed = testChurnAllocations(10000, 100000, 40) && passed;
+    passed = testChurnAllocations(10000, 100000, 80) && passed;
+    passed = testPmrQueue(5000) && passed;
+
+    passed = testConcurrentQueue(4, 20000) && passed;
+    passed = testWaitAndRemove() && passed;
+    passed = testShardedOrder(10000) && passed;
+    passed = testSnapshots(5000) && passed;
+
+    //Half of a queue this large is selected even though it is not three
+    // quarters of it
+    bool large = testRemoveN<PatientPriorityQueue>(300000, 150000, 4);
+    cout << "removeN of half of 300000 patients: "
+         << (large ? "ok" : "FAILED") << endl;
+
+    bool lockFree = testLockFreeArrivalOrder(4, 20000);
+    cout << "lock-free queue with 4 producers keeps arrival order: "
+         << (lockFree ? "ok" : "FAILED") << endl;
+
+    return passed && large && lockFree ? 0 : 1;
+}
+
+template <class Queue>
+bool testRemoveN(int patients, int count, int codes) {
+    Queue batched;
+    Queue single;
+    mt19937 random(patients * 31 + count);
+    uniform_int_distribution<int> priority(1, codes);
+
+    vector<PatientHandle> batchedHandles;
+    vector<PatientHandle> singleHandles;
+    for (int i = 0; i < patients; i++) {
+        string name = "Patient " + std::to_string(i);
+        int code = priority(random);
+        batchedHandles.push_back(batched.add(name, code));
+        singleHandles.push_back(single.add(name, code));
+    }
+
+    //Leave holes and recycled slots behind, and move some Patients around
+    for (int i = 0; i < patients; i += 7) {
+        batched.cancel(batchedHandles[i]);
+        single.cancel(singleHandles[i]);
+    }
+    for (int i = 3; i < patients; i += 11) {
+        if (i % 7 == 0)
+            continue;
+        int code = i % codes + 1;
+        batched.changePriority(batchedHandles[i], code);
+        single.changePriority(singleHandles[i], code);
+    }
+
+    int expected = min(count, single.size());
+    vector<Patient> batch;
+    int removed = batched.removeN(count, batch);
+    if (removed != expected || (int) batch.size() != expected) {
+        cout << "  " << patients << " patients, batch of " << count
+             << ": removed " << removed << " instead of " << expected
+             << endl;
+        return false;
+    }
+
+    //The batch is in the order remove hands the Patients out
+    for (int i = 0; i < expected; i++) {
+        Patient next = single.remove();
+        if (batch[i].to_string() != next.to_string()) {
+            cout << "  " << patients << " patients, batch of " << count
+                 << ": Patient " << i << " of the batch is\n    "
+                 << batch[i].to_string() << "  instead of\n    "
+                 << next.to_string();
+            return false;
+        }
+    }
+
+    //What is left is still a heap holding the same Patients
+    if (batched.size() != single.size()) {
+        cout << "  " << patients << " patients, batch of " << count
+             << ": " << batched.size() << " left instead of "
+             << single.size() << endl;
+        return false;
+    }
+    while (single.size() > 0) {
+        if (batched.remove().to_string() != single.remove().to_string()) {
+            cout << "  " << patients << " patients, batch of " << count
+                 << ": the queue left behind is out of order\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class Queue>
+bool testRemoveNSizes(const string &queueName) {
+    bool passed = true;
+    for (int patients : {1, 7, 100, 1000, 5000}) {
+        int waiting = patients - (patients + 6) / 7;
+        for (int count : {0, 1, waiting / 4, waiting / 2, waiting * 3 / 4,
+                          waiting, waiting + 5}) {
+
+            //One code makes arrival order the only thing that tells the
+            // Patients apart
+            for (int codes : {1, PRIORITY_LEVEL_COUNT})
+                passed = testRemoveN<Queue>(patients, count, codes) && passed;
+        }
+    }
+    cout << "removeN on the " << queueName << ": "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+template <class Queue>
+bool testStaleHandle(const string &queueName) {
+    Queue queue;
+    queue.add("first", 2);
+    PatientHandle old = queue.add("cancelled", 3);
+    queue.add("third", 1);
+    bool passed = queue.cancel(old).has_value() && !queue.contains(old);
+
+    //The pool hands the freed slot to one of the next patients
+    PatientHandle reused = {-1, 0};
+    for (int i = 0; i < 1000 && reused.slot != old.slot; i++)
+        reused = queue.add("new " + std::to_string(i), 4);
+    passed = passed && reused.slot == old.slot && queue.contains(reused);
+
+    //The old handle names the slot but not the patient in it
+    int size = queue.size();
+    passed = passed && !queue.contains(old) && !queue.cancel(old) &&
+             !queue.changePriority(old, 1) && queue.size() == size;
+
+    //The new patient is still the one in the slot
+    optional<typename Queue::PatientType> moved = queue.cancel(reused);
+    passed = passed && moved && moved->getPriorityCode() == 4 &&
+             moved->getNameView() == "new " + std::to_string(size - 3);
+    cout << "stale handles on the " << queueName << ": "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+template <class Queue>
+bool testHandlesAgainstMap(const string &queueName, int operations) {
+    Queue queue;
+    mt19937 random(operations);
+    uniform_int_distribution<int> priority(1, PRIORITY_LEVEL_COUNT);
+    uniform_int_distribution<int> operation(0, 9);
+
+    //Each Patient ever added, whether it is still waiting and its key in
+    // the reference, where the arrival order makes every key different
+    typedef pair<int, uint64_t> Key;
+    map<Key, string> reference;
+    vector<PatientHandle> handles;
+    vector<Key> keys;
+    vector<bool> waiting;
+    string failure;
+    for (int i = 0; i < operations && failure.empty(); i++) {
+        int chosen = operation(random);
+
+        //Keep the queue small so slots are reused again and again
+        if (chosen < 4 && reference.size() < 50) {
+            string name = "Patient " + std::to_string(handles.size());
+            int code = priority(random);
+            handles.push_back(queue.add(name, code));
+            keys.push_back(Key(code, handles.size() - 1));
+            waiting.push_back(true);
+            reference.emplace(keys.back(), name);
+        } else if (chosen < 6) {
+            if (reference.empty())
+                continue;
+            auto first = reference.begin();
+            typename Queue::PatientType next = queue.remove();
+            if (next.getNameView() != first->second ||
+                next.getPriorityCode() != first->first.first)
+                failure = "remove gave " + next.to_string();
+            waiting[stoi(first->second.substr(8))] = false;
+            reference.erase(first);
+        } else if (!handles.empty()) {
+
+            //Any handle ever handed out, most of them stale
+            int patient = uniform_int_distribution<int>(
+                    0, (int) handles.size() - 1)(random);
+            bool expected = waiting[patient];
+            if (queue.contains(handles[patient]) != expected)
+                failure = "contains was wrong for patient " +
+                          std::to_string(patient);
+            else if (chosen < 8) {
+                optional<typename Queue::PatientType> cancelled =
+                        queue.cancel(handles[patient]);
+                if (cancelled.has_value() != expected ||
+                    (cancelled && cancelled->getNameView() !=
+                                  reference[keys[patient]]))
+                    failure = "cancel was wrong for patient " +
+                              std::to_string(patient);
+                if (expected) {
+                    reference.erase(keys[patient]);
+                    waiting[patient] = false;
+                }
+            } else {
+                int code = priority(random);
+                if (queue.changePriority(handles[patient], code) != expected)
+                    failure = "changePriority was wrong for patient " +
+                              std::to_string(patient);
+                if (expected) {
+                    string name = reference[keys[patient]];
+                    reference.erase(keys[patient]);
+                    keys[patient].first = code;
+                    reference.emplace(keys[patient], name);
+                }
+            }
+        }
+        if (failure.empty() && queue.size() != (int) reference.size())
+            failure = "the queue holds " + std::to_string(queue.size()) +
+                      " patients instead of " +
+                      std::to_string(reference.size());
+    }
+
+    //What is left comes out in the order of the reference
+    for (auto &entry : reference) {
+        if (!failure.empty())
+            break;
+        if (queue.remove().getNameView() != entry.second)
+            failure = "the patients left came out of order";
+    }
+    if (!failure.empty())
+        cout << "  " << failure << endl;
+    cout << "handles against a map on the " << queueName << ": "
+         << (failure.empty() ? "ok" : "FAILED") << endl;
+    return failure.empty();
+}
+
+bool testNameAllocations(int patients) {
+    bool passed = true;
+    for (size_t length = 1; length <= PatientRecord::INLINE_NAME_CAPACITY;
+         length++) {
+        PatientPriorityQueue queue;
+        queue.reserve(patients);
+        vector<string> names;
+        for (int i = 0; i < patients; i++) {
+            string number = std::to_string(i);
+            names.push_back(string(length - min(length, number.size()), 'x') +
+                            number.substr(0, length));
+        }
+
+        //The first two rounds warm up the pool
+        long long allocations = 0;
+        for (int round = 0; round < 3; round++) {
+            long long before = allocationCount;
+            for (int i = 0; i < patients; i++)
+                queue.add(names[i], i % 4 + 1);
+            while (queue.size() > 0)
+                queue.pop();
+            allocations = allocationCount - before;
+        }
+        if (allocations != 0) {
+            cout << "  " << allocations << " allocations for " << patients
+                 << " patients with " << length << " character names\n";
+            passed = false;
+        }
+    }
+
+    //A name too long for the small string buffer is the one allocation
+    // of a Patient that is handed back
+    PatientPriorityQueue queue;
+    queue.reserve(patients);
+    string name(40, 'x');
+    long long allocations = 0;
+    for (int round = 0; round < 3; round++) {
+        long long before = allocationCount;
+        for (int i = 0; i < patients; i++)
+            queue.add(name, i % 4 + 1);
+        while (queue.size() > 0) {
+            string removed = queue.remove().getPatientName();
+        }
+        allocations = allocationCount - before;
+    }
+    if (allocations != patients) {
+        cout << "  " << allocations << " allocations to remove " << patients
+             << " patients instead of one each\n";
+        passed = false;
+    }
+    cout << "names of up to " << PatientRecord::INLINE_NAME_CAPACITY
+         << " characters do not allocate: " << (passed ? "ok" : "FAILED")
+         << endl;
+    return passed;
+}
+
+bool testChurnAllocations(int waiting, int cycles, int nameLength) {
+    PatientPriorityQueue queue;
+    string name(nameLength, 'x');
+    for (int i = 0; i < waiting; i++)
+        queue.add(name, i % 4 + 1);
+
+    //The first two rounds warm up the pool and both buffers of the arena
+    long long allocations = 0;
+    for (int round = 0; round < 3; round++) {
+        long long before = allocationCount;
+        for (int i = 0; i < cycles; i++) {
+            queue.add(name, i % 4 + 1);
+            queue.pop();
+        }
+        allocations = allocationCount - before;
+    }
+
+    if (allocations != 0)
+        cout << "  " << (double) allocations / cycles
+             << " allocations per cycle\n";
+    cout << "add/next churn with " << waiting << " waiting and "
+         << nameLength << " character names does not allocate: "
+         << (allocations == 0 ? "ok" : "FAILED") << endl;
+    return allocations == 0;
+}
+
+template <class Queue, class Batch>
+void runPmrSession(Queue &queue, int patients, Batch &batch) {
+    string shortName(20, 's');
+    string longName(80, 'l');
+    vector<PatientHandle> handles;
+    handles.reserve(patients);
+    for (int i = 0; i < patients; i++)
+        handles.push_back(queue.add(i % 4 == 0 ? longName + to_string(i)
+                                               : shortName + to_string(i),
+                                    i % PRIORITY_LEVEL_COUNT + 1));
+    for (int i = 0; i < patients; i += 10)
+        queue.cancel(handles[i]);
+
+    //The small batch pops and the large one selects
+    queue.removeN(10, batch);
+    queue.removeN(queue.size() * 3 / 4, batch);
+    while (queue.size() > 0)
+        batch.push_back(queue.remove());
+}
+
+bool testPmrQueue(int patients) {
+    vector<Patient> expected;
+    expected.reserve(patients);
+    PatientPriorityQueue reference;
+    runPmrSession(reference, patients, expected);
+
+    //The buffer is big enough for the session and has no upstream to fall
+    // back to, so the global count only sees what the session allocates
+    // outside the queue
+    vector<char> buffer(patients * 1024);
+    pmr::monotonic_buffer_resource session(buffer.data(), buffer.size(),
+                                           pmr::null_memory_resource());
+    bool passed = true;
+    {
+        vector<PmrPatient> removed;
+        removed.reserve(patients);
+        PmrPatientPriorityQueue<2> queue(&session);
+        long long before = allocationCount;
+        runPmrSession(queue, patients, removed);
+        long long allocations = allocationCount - before;
+
+        //The two names, the name of every patient and the handles
+        long long outside = patients + 3;
+        if (allocations != outside) {
+            cout << "  " << allocations - outside
+                 << " allocations did not come from the buffer\n";
+            passed = false;
+        }
+        if (removed.size() != expected.size()) {
+            cout << "  " << removed.size() << " patients came out instead of "
+                 << expected.size() << endl;
+            passed = false;
+        }
+        for (size_t i = 0; passed && i < removed.size(); i++) {
+            if (removed[i].to_string() != expected[i].to_string()) {
+                cout << "  Patient " << i << " is\n    "
+                     << removed[i].to_string() << "  instead of\n    "
+                     << expected[i].to_string();
+                passed = false;
+            }
+        }
+    }
+    cout << "pmr heap allocates only from its resource: "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+bool testConcurrentQueue(int producers, int perProducer) {
+    bool passed = true;
+    {
+        ConcurrentPatientQueue queue;
+        PatientPriorityQueue reference;
+        mt19937 random(producers);
+        uniform_int_distribution<int> priority(1, PRIORITY_LEVEL_COUNT);
+        for (int i = 0; i < perProducer; i++) {
+            string name = "Patient " + std::to_string(i);
+            int code = priority(random);
+            queue.add(name, code);
+            reference.add(name, code);
+        }
+
+        //Batches and single removes both follow the order of the heap
+        vector<PatientPtr> removed;
+        queue.removeN(perProducer / 3, removed);
+        while (PatientPtr next = queue.tryRemove())
+            removed.push_back(next);
+        for (size_t i = 0; passed && i < removed.size(); i++) {
+            Patient next = reference.remove();
+            if (removed[i]->to_string() != next.to_string()) {
+                cout << "  Patient " << i << " is\n    "
+                     << removed[i]->to_string() << "  instead of\n    "
+                     << next.to_string();
+                passed = false;
+            }
+        }
+        if (passed && (removed.size() != (size_t) perProducer ||
+                       queue.size() != 0)) {
+            cout << "  " << removed.size() << " of " << perProducer
+                 << " patients came out\n";
+            passed = false;
+        }
+    }
+
+    ConcurrentPatientQueue queue;
+    atomic<int> finished(0);
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, &finished, p, perProducer]() {
+            for (int i = 0; i < perProducer; i++)
+                queue.add(std::to_string(p) + " " + std::to_string(i),
+                          i % PRIORITY_LEVEL_COUNT + 1);
+            finished.fetch_add(1);
+        });
+    }
+
+    //Remove while the producers are adding, then take what is left
+    vector<PatientPtr> removed;
+    while (finished.load() < producers) {
+        if (PatientPtr next = queue.tryRemove())
+            removed.push_back(next);
+    }
+    for (thread &producer : threads)
+        producer.join();
+    while (PatientPtr next = queue.tryRemove())
+        removed.push_back(next);
+
+    if (passed && removed.size() != (size_t) producers * perProducer) {
+        cout << "  " << removed.size() << " of " << producers * perProducer
+             << " patients came out with producers\n";
+        passed = false;
+    }
+
+    //A patient is in the queue before every later one of its producer, so
+    // one consumer sees the patients of a producer and code in order
+    vector<bool> seen(producers * perProducer, false);
+    vector<vector<int>> lastNumber(producers,
+                                   vector<int>(PRIORITY_LEVEL_COUNT + 1, -1));
+    for (size_t i = 0; passed && i < removed.size(); i++) {
+        string name(removed[i]->getNameView());
+        int producer = stoi(name);
+        int number = stoi(name.substr(name.find(' ') + 1));
+        int code = removed[i]->getPriorityCode();
+        if (seen[producer * perProducer + number] ||
+            number <= lastNumber[producer][code]) {
+            cout << "  patient " << number << " of producer " << producer
+                 << " came out twice or out of order\n";
+            passed = false;
+        }
+        seen[producer * perProducer + number] = true;
+        lastNumber[producer][code] = number;
+    }
+    cout << "concurrent queue with " << producers << " producers: "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+bool testWaitAndRemove() {
+    ConcurrentPatientQueue queue;
+    bool passed = true;
+
+    //Nobody adds, so the wait ends empty once the timeout is over
+    auto start = chrono::steady_clock::now();
+    PatientPtr none = queue.waitAndRemoveFor(chrono::milliseconds(50));
+    auto waited = chrono::steady_clock::now() - start;
+    if (none != nullptr || waited < chrono::milliseconds(50)) {
+        cout << "  the wait on an empty queue did not time out empty\n";
+        passed = false;
+    }
+
+    //One consumer waits with a timeout far longer than the test and two
+    // without one, and each gets one of the patients added later
+    PatientPtr timed;
+    PatientPtr untimed[2];
+    thread timedConsumer([&queue, &timed]() {
+        timed = queue.waitAndRemoveFor(chrono::seconds(60));
+    });
+    thread consumers[2];
+    for (int i = 0; i < 2; i++)
+        consumers[i] = thread([&queue, &untimed, i]() {
+            untimed[i] = queue.waitAndRemove();
+        });
+    this_thread::sleep_for(chrono::milliseconds(50));
+    for (int i = 0; i < 3; i++)
+        queue.add("late " + std::to_string(i), i + 1);
+    timedConsumer.join();
+    for (thread &consumer : consumers)
+        consumer.join();
+
+    vector<string> names;
+    for (const PatientPtr &patient : {timed, untimed[0], untimed[1]}) {
+        if (patient == nullptr) {
+            cout << "  a waiting consumer got no patient\n";
+            passed = false;
+        } else {
+            names.push_back(string(patient->getNameView()));
+        }
+    }
+    sort(names.begin(), names.end());
+    if (passed && (names != vector<string>{"late 0", "late 1", "late 2"} ||
+                   queue.size() != 0)) {
+        cout << "  the waiting consumers got the wrong patients\n";
+        passed = false;
+    }
+    cout << "waiting consumers wake for patients added later: "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+bool testShardedOrder(int patients) {
+    bool passed = true;
+    mt19937 random(patients);
+    uniform_int_distribution<int> priority(1, PRIORITY_LEVEL_COUNT);
+    {
+        ShardedPatientQueue queue(3);
+        PatientPriorityQueue reference;
+        for (int i = 0; i < patients; i++) {
+            string name = "Patient " + std::to_string(i);
+            int code = priority(random);
+            queue.add(i % 3 == 0 ? 0 : 2, name, code);
+            reference.add(name, code);
+        }
+
+        //The shards share the arrival order, so stealing the best head
+        // every time gives the order of one heap
+        for (int i = 0; passed && i < patients; i++) {
+            PatientPtr next = queue.tryRemove(1);
+            Patient expected = reference.remove();
+            if (next == nullptr ||
+                next->to_string() != expected.to_string()) {
+                cout << "  Patient " << i << " stolen is not\n    "
+                     << expected.to_string();
+                passed = false;
+            }
+        }
+        if (passed && (queue.tryRemove(1) != nullptr ||
+                       queue.getSteals() != patients)) {
+            cout << "  " << queue.getSteals() << " of " << patients
+                 << " patients were stolen\n";
+            passed = false;
+        }
+    }
+
+    //A clinician stays home only for a code as urgent as any other head
+    ShardedPatientQueue queue(3);
+    for (int i = 0; i < patients; i++)
+        queue.add(i % 3, "Patient " + std::to_string(i), priority(random));
+    int lastCode = 0;
+    for (int i = 0; passed && i < patients; i++) {
+        PatientPtr next = queue.tryRemove(i % 3);
+        if (next == nullptr || next->getPriorityCode() < lastCode) {
+            cout << "  patient " << i << " left out of priority order\n";
+            passed = false;
+        } else {
+            lastCode = next->getPriorityCode();
+        }
+    }
+    cout << "sharded queue steals in priority order: "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+bool testSnapshots(int patients) {
+    ConcurrentPatientQueue queue;
+    for (int i = 0; i < patients; i++)
+        queue.add("Patient " + std::to_string(i), i % PRIORITY_LEVEL_COUNT + 1);
+    shared_ptr<const ConcurrentPatientQueue::Snapshot> first =
+            queue.snapshot();
+    string listed = first->to_string();
+    vector<const Patient *> entries;
+    for (int i = 0; i < first->size(); i++)
+        entries.push_back(&(*first)[i]);
+
+    //Change every chunk the snapshot shares with the queue
+    for (int i = 0; i < patients; i++)
+        queue.add("Later " + std::to_string(i), 1);
+    for (int i = 0; i < patients / 2; i++)
+        queue.tryRemove();
+    vector<PatientPtr> batch;
+    queue.removeN(patients, batch);
+
+    bool passed = first->size() == patients &&
+                  first->to_string() == listed;
+    for (int i = 0; passed && i < first->size(); i++)
+        passed = &(*first)[i] == entries[i];
+    shared_ptr<const ConcurrentPatientQueue::Snapshot> second =
+            queue.snapshot();
+    passed = passed && second->getVersion() != first->getVersion() &&
+             second->size() == queue.size();
+    if (!passed)
+        cout << "  a snapshot changed after the queue did\n";
+
+    //Every snapshot the reader takes while the writer works is a heap, and
+    // stays the same while the reader walks it twice
+    atomic<bool> writing(true);
+    atomic<bool> consistent(true);
+    thread reader([&queue, &writing, &consistent]() {
+        while (writing.load()) {
+            shared_ptr<const ConcurrentPatientQueue::Snapshot> snapshot =
+                    queue.snapshot();
+            string before = snapshot->to_string();
+            for (int i = 1; i < snapshot->size(); i++) {
+                if ((*snapshot)[(i - 1) / 2].getOrderKey() >
+                    (*snapshot)[i].getOrderKey())
+                    consistent.store(false);
+            }
+            if (snapshot->to_string() != before)
+                consistent.store(false);
+        }
+    });
+    for (int i = 0; i < patients * 4; i++) {
+        queue.add("Writer " + std::to_string(i), i % PRIORITY_LEVEL_COUNT + 1);
+        if (i % 3 != 0)
+            queue.tryRemove();
+    }
+    writing.store(false);
+    reader.join();
+    if (!consistent.load()) {
+        cout << "  a snapshot changed or was out of order while read\n";
+        passed = false;
+    }
+    cout << "snapshots do not change after they are taken: "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+bool testLockFreeArrivalOrder(int producers, int perProducer) {
+    LockFreeBucketQueue queue(producers * perProducer);
+    atomic<int> finished(0);
+    atomic<bool> full(false);
+
+    //The name of a patient is the number of its producer and its number
+    // among the patients of that producer
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, &finished, &full, p, perProducer]() {
+            for (int i = 0; i < perProducer; i++) {
+                string name = std::to_string(p) + " " + std::to_string(i);
+                if (!queue.add(name, i % PRIORITY_LEVEL_COUNT + 1))
+                    full.store(true);
+            }
+            finished.fetch_add(1);
+        });
+    }
+
+    //Remove while the producers are adding, then take what is left
+    vector<Patient> removed;
+    while (finished.load() < producers) {
+        optional<Patient> next = queue.tryRemove();
+        if (next)
+            removed.push_back(std::move(*next));
+    }
+    for (thread &producer : threads)
+        producer.join();
+    while (optional<Patient> next = queue.tryRemove())
+        removed.push_back(std::move(*next));
+
+    if (full.load() || (int) removed.size() != producers * perProducer) {
+        cout << "  " << removed.size() << " of "
+             << producers * perProducer << " patients came out\n";
+        return false;
+    }
+
+    //The key is the code in the top byte over the arrival order
+    const uint64_t arrivalMask = ((uint64_t) 1 << 56) - 1;
+    vector<uint64_t> lastArrival(PRIORITY_LEVEL_COUNT + 1, 0);
+    vector<bool> anyOfCode(PRIORITY_LEVEL_COUNT + 1, false);
+    vector<vector<int>> lastNumber(producers,
+                                   vector<int>(PRIORITY_LEVEL_COUNT + 1, -1));
+    vector<uint64_t> arrivals;
+    for (const Patient &patient : removed) {
+        uint64_t key = patient.getOrderKey();
+        int code = (int) (key >> 56);
+        uint64_t arrival = key & arrivalMask;
+        arrivals.push_back(arrival);
+
+        //One thread removed them all, so each ring came out in order
+        if (anyOfCode[code] && arrival <= lastArrival[code]) {
+            cout << "  a patient of code " << code << " with arrival "
+                 << arrival << " left after arrival " << lastArrival[code]
+                 << endl;
+            return false;
+        }
+        anyOfCode[code] = true;
+        lastArrival[code] = arrival;
+
+        string name(patient.getNameView());
+        int producer = stoi(name);
+        int number = stoi(name.substr(name.find(' ') + 1));
+        if (number <= lastNumber[producer][code]) {
+            cout << "  patient " << number << " of producer " << producer
+                 << " left after patient " << lastNumber[producer][code]
+                 << endl;
+            return false;
+        }
+        lastNumber[producer][code] = number;
+    }
+
+    sort(arrivals.begin(), arrivals.end());
+    if (adjacent_find(arrivals.begin(), arrivals.end()) != arrivals.end()) {
+        cout << "  two patients got the same arrival order\n";
+        return false;
+    }
+    return true;
+}